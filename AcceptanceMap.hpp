@@ -0,0 +1,360 @@
+#ifndef NUMERICAL_CPP_ACCEPTANCEMAP_HPP
+#define NUMERICAL_CPP_ACCEPTANCEMAP_HPP
+
+#include "Particle.hpp"
+#include "Scheduler.hpp"
+#include "ProblemParameters.hpp"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <filesystem>
+
+#define DEFAULT_MAP_TOLERANCE 1e-4      //of y0 / R, and of the vz0 range / 2
+#define DEFAULT_MAP_COLUMNS 16
+#define MAX_MAP_COLUMNS 4096            //per grid level
+#define MAP_SCAN_POINTS 64              //coarse samples per column before bisecting
+
+/**
+ * Pass / fail of stage c as a function of the initial condition, precomputed for fixed fields
+ * and geometry on the plane (u, d) = (y0 / R, vz0 / (E/B) - 1).
+ * The map is a set of columns at evenly spaced d. Each column stores where along u the outcome
+ * flips, found by bisecting the integrator's own classification to `tolerance`, plus whether
+ * u = -1 passes. Between two columns the flip points are interpolated linearly. The number of
+ * columns is doubled until the interpolated flip points at every column midpoint are within
+ * `tolerance` of bisected ones.
+ * Where the boundary runs out through u = +-1 the two columns of a cell disagree on the number
+ * of flips and cannot be interpolated; such a cell gets its own finer grid of columns, refined
+ * the same way until the cells that still disagree are at most tolerance * (d range) / 2 wide,
+ * and there the nearer column decides.
+ * classify() is O(1): at most two grid lookups and a walk over the (few) flip points of two
+ * columns. Only particles within about tolerance of the boundary (in the normalized plane) can
+ * come out differently from a full integration. Features narrower than 2 / MAP_SCAN_POINTS in u
+ * can be missed by the coarse scan.
+ */
+class AcceptanceMap
+{
+public:
+    double d_min = 0;
+    double d_max = 0;
+    double tolerance = DEFAULT_MAP_TOLERANCE;
+    std::uint32_t top_columns = 0;              //columns [0, top_columns) form the main grid
+    std::vector<std::uint32_t> offsets;         //column c has flips [offsets[c], offsets[c + 1])
+    std::vector<double> flips;                  //u of every outcome change, ascending in each column
+    std::vector<unsigned char> passes_at_bottom;    //outcome at u = -1
+    std::vector<std::uint32_t> sub_first;       //per main cell: first column of its finer grid, 0 if none
+    std::vector<std::uint32_t> sub_count;
+
+    AcceptanceMap() = default;
+
+    /**
+     * builds the map over vz0 in [vz_min, vz_max] by integrating with params (method, dt, ...)
+     */
+    AcceptanceMap(ProblemParameters params, long double vz_min, long double vz_max,
+                  double tolerance = DEFAULT_MAP_TOLERANCE, unsigned n_threads = 1)
+            : tolerance(tolerance), params(params)
+    {
+        this->params.record = FINAL_ONLY;
+        drift = params.E / params.B;
+        d_min = (double) (vz_min / drift - 1);
+        d_max = (double) (vz_max / drift - 1);
+
+        auto main_grid = build(d_min, d_max, DEFAULT_MAP_COLUMNS, std::numeric_limits<double>::infinity(),
+                               n_threads);
+        top_columns = (std::uint32_t) main_grid.size();
+        offsets.assign(1, 0);
+        append(main_grid);
+
+        double min_width = tolerance * (d_max - d_min) / 2;
+        sub_first.assign(top_columns - 1, 0);
+        sub_count.assign(top_columns - 1, 0);
+        for (std::size_t c = 0; c + 1 < top_columns; c++)
+        {
+            if (!same_topology(main_grid[c], main_grid[c + 1]))
+            {
+                auto sub_grid = build(column_d(d_min, d_max, c, top_columns), column_d(d_min, d_max, c + 1, top_columns),
+                                      2, min_width, n_threads);
+                sub_first[c] = (std::uint32_t) passes_at_bottom.size();
+                sub_count[c] = (std::uint32_t) sub_grid.size();
+                append(sub_grid);
+            }
+        }
+    }
+
+    bool passes(long double y0, long double vz0) const
+    {
+        return classify((double) (y0 / params.R), (double) (vz0 / drift - 1));
+    }
+
+    /**
+     * outcome at (u, d)
+     */
+    bool classify(double u, double d) const
+    {
+        double f = std::clamp((d - d_min) / (d_max - d_min), 0.0, 1.0);
+        double position = f * (top_columns - 1);
+        auto c = std::min<std::size_t>((std::size_t) position, top_columns - 2);
+        if (sub_first[c])
+        {
+            return classify_in(u, sub_first[c], sub_count[c], position - c);
+        }
+        return classify_in(u, 0, top_columns, f);
+    }
+
+    void save(const std::string &filename) const
+    {
+        std::ofstream output(filename, std::ios::binary);
+        std::uint64_t sizes[3] = {passes_at_bottom.size(), flips.size(), top_columns};
+        double header[5] = {d_min, d_max, tolerance, (double) drift, (double) params.R};
+        output.write("WFMAP2\0\0", 8);
+        output.write(reinterpret_cast<const char *>(sizes), sizeof(sizes));
+        output.write(reinterpret_cast<const char *>(header), sizeof(header));
+        write_array(output, offsets);
+        write_array(output, flips);
+        write_array(output, passes_at_bottom);
+        write_array(output, sub_first);
+        write_array(output, sub_count);
+    }
+
+    static AcceptanceMap load(const std::string &filename)
+    {
+        std::ifstream input(filename, std::ios::binary);
+        char magic[8];
+        std::uint64_t sizes[3];
+        double header[5];
+        input.read(magic, 8);
+        input.read(reinterpret_cast<char *>(sizes), sizeof(sizes));
+        input.read(reinterpret_cast<char *>(header), sizeof(header));
+        if (!input || std::string(magic, 6) != "WFMAP2")
+        {
+            throw std::runtime_error(filename + " is not an acceptance map");
+        }
+        //the d range and the scales divide in classify() and passes()
+        if (!std::all_of(header, header + 5, [](double value) { return std::isfinite(value); }) ||
+            !(header[1] > header[0]) || header[3] == 0 || !(header[4] > 0))
+        {
+            throw std::runtime_error(filename + " has an invalid header");
+        }
+        //checked against the file size before anything is allocated; every count is bounded by the
+        //file size first, so the expected size cannot overflow
+        auto file_size = std::filesystem::file_size(filename);
+        std::uint64_t n_columns = sizes[0], n_flips = sizes[1], n_top = sizes[2];
+        if (n_columns > file_size || n_flips > file_size / sizeof(double) || n_top < 2 || n_top > n_columns ||
+            72 + (n_columns + 1) * sizeof(std::uint32_t) + n_flips * sizeof(double) + n_columns +
+            2 * (n_top - 1) * sizeof(std::uint32_t) != file_size)
+        {
+            throw std::runtime_error(filename + " does not hold the " + std::to_string(n_columns) + " columns and " +
+                                     std::to_string(n_flips) + " flip points its header announces");
+        }
+        AcceptanceMap map;
+        map.d_min = header[0];
+        map.d_max = header[1];
+        map.tolerance = header[2];
+        map.drift = header[3];
+        map.params.R = header[4];
+        map.top_columns = (std::uint32_t) sizes[2];
+        read_array(input, map.offsets, sizes[0] + 1);
+        read_array(input, map.flips, sizes[1]);
+        read_array(input, map.passes_at_bottom, sizes[0]);
+        read_array(input, map.sub_first, sizes[2] - 1);
+        read_array(input, map.sub_count, sizes[2] - 1);
+        if (!input)
+        {
+            throw std::runtime_error(filename + " is truncated");
+        }
+        map.check_columns(filename);
+        return map;
+    }
+
+private:
+    class Column
+    {
+    public:
+        bool bottom = false;
+        std::vector<double> flips;
+    };
+
+    ProblemParameters params;
+    long double drift = 1;
+
+    static double column_d(double a, double b, std::size_t c, std::size_t n_columns)
+    {
+        return a + (b - a) * c / (n_columns - 1);
+    }
+
+    /**
+     * throws unless every column's flips lie inside the flip array and every finer grid is made of
+     * at least two columns past the main grid, so classify() stays within the arrays
+     */
+    void check_columns(const std::string &filename) const
+    {
+        bool valid = offsets.front() == 0 && offsets.back() == flips.size() &&
+                     std::is_sorted(offsets.begin(), offsets.end());
+        for (std::size_t c = 0; valid && c + 1 < top_columns; c++)
+        {
+            valid = !sub_first[c] || (sub_first[c] >= top_columns && sub_first[c] <= passes_at_bottom.size() &&
+                                      sub_count[c] >= 2 && sub_count[c] <= passes_at_bottom.size() - sub_first[c]);
+        }
+        if (!valid)
+        {
+            throw std::runtime_error(filename + " has inconsistent column offsets or sub-grids");
+        }
+    }
+
+    static bool same_topology(const Column &a, const Column &b)
+    {
+        return a.bottom == b.bottom && a.flips.size() == b.flips.size();
+    }
+
+    bool integrate_passes(double u, double d) const
+    {
+        auto local = params;
+        Particle particle({{u * params.R, 0},
+                           {0,            (d + 1) * drift}}, &local);
+        return !particle.run('c');
+    }
+
+    /**
+     * n + 1 columns evenly spaced over d in [a, b], doubled until every cell either interpolates
+     * its midpoint column within tolerance or, if its columns disagree, is at most min_width wide
+     */
+    std::vector<Column> build(double a, double b, std::size_t n, double min_width, unsigned n_threads) const
+    {
+        std::vector<Column> columns(n + 1);
+        scan(columns, a, b, 0, 1, n_threads);
+        while (columns.size() - 1 < MAX_MAP_COLUMNS)
+        {
+            double width = (b - a) / (columns.size() - 1);
+            std::vector<Column> refined(2 * (columns.size() - 1) + 1);
+            for (std::size_t c = 0; c < columns.size(); c++)
+            {
+                refined[2 * c] = std::move(columns[c]);
+            }
+            scan(refined, a, b, 1, 2, n_threads);
+
+            bool within = true;
+            for (std::size_t c = 1; c < refined.size() && within; c += 2)
+            {
+                const auto &left = refined[c - 1], &right = refined[c + 1];
+                if (!same_topology(left, right) || !same_topology(left, refined[c]))
+                {
+                    within = width <= min_width;
+                    continue;
+                }
+                for (std::size_t k = 0; within && k < left.flips.size(); k++)
+                {
+                    within = std::abs((left.flips[k] + right.flips[k]) / 2 - refined[c].flips[k]) <= tolerance;
+                }
+            }
+            columns = std::move(refined);
+            if (within)
+            {
+                break;
+            }
+        }
+        return columns;
+    }
+
+    /**
+     * fills columns first, first + stride, ... : coarse scan along u, then bisection of every change
+     */
+    void scan(std::vector<Column> &columns, double a, double b, std::size_t first, std::size_t stride,
+              unsigned n_threads) const
+    {
+        std::size_t n = (columns.size() - first + stride - 1) / stride;
+        WorkStealingScheduler scheduler(n_threads, 1);
+        scheduler.run(n, [&](std::size_t begin, std::size_t end, unsigned) {
+            for (std::size_t i = begin; i < end; i++)
+            {
+                auto c = first + i * stride;
+                auto d = column_d(a, b, c, columns.size());
+                auto &column = columns[c];
+                column.flips.clear();
+                double previous_u = -1;
+                bool previous = integrate_passes(previous_u, d);
+                column.bottom = previous;
+                for (int k = 1; k <= MAP_SCAN_POINTS; k++)
+                {
+                    double u = -1 + 2.0 * k / MAP_SCAN_POINTS;
+                    bool current = integrate_passes(u, d);
+                    if (current != previous)
+                    {
+                        double lo = previous_u, hi = u;
+                        while (hi - lo > tolerance / 2)
+                        {
+                            double mid = lo + (hi - lo) / 2;
+                            (integrate_passes(mid, d) == previous ? lo : hi) = mid;
+                        }
+                        column.flips.push_back(lo + (hi - lo) / 2);
+                    }
+                    previous = current;
+                    previous_u = u;
+                }
+            }
+        });
+    }
+
+    void append(const std::vector<Column> &columns)
+    {
+        for (const auto &column: columns)
+        {
+            flips.insert(flips.end(), column.flips.begin(), column.flips.end());
+            offsets.push_back((std::uint32_t) flips.size());
+            passes_at_bottom.push_back(column.bottom);
+        }
+    }
+
+    /**
+     * outcome at u on the grid of `count` columns starting at `first`, at fraction f of its d range
+     */
+    bool classify_in(double u, std::size_t first, std::size_t count, double f) const
+    {
+        double position = f * (count - 1);
+        auto c = first + std::min<std::size_t>((std::size_t) position, count - 2);
+        double g = position - (c - first);
+
+        auto begin0 = offsets[c], end0 = offsets[c + 1];
+        auto begin1 = offsets[c + 1], end1 = offsets[c + 2];
+        if (end0 - begin0 != end1 - begin1 || passes_at_bottom[c] != passes_at_bottom[c + 1])
+        {
+            auto nearest = g < 0.5 ? c : c + 1;
+            return outcome(u, passes_at_bottom[nearest], offsets[nearest + 1] - offsets[nearest],
+                           [&](std::size_t k) { return flips[offsets[nearest] + k]; });
+        }
+        return outcome(u, passes_at_bottom[c], end0 - begin0, [&](std::size_t k) {
+            return (1 - g) * flips[begin0 + k] + g * flips[begin1 + k];
+        });
+    }
+
+    //outcome at u given the outcome at u = -1 and the n flip points flip(k)
+    template<typename Flip>
+    static bool outcome(double u, bool bottom, std::size_t n, Flip &&flip)
+    {
+        bool result = bottom;
+        for (std::size_t k = 0; k < n && flip(k) <= u; k++)
+        {
+            result = !result;
+        }
+        return result;
+    }
+
+    template<typename T>
+    static void write_array(std::ofstream &output, const std::vector<T> &array)
+    {
+        output.write(reinterpret_cast<const char *>(array.data()), (std::streamsize) (array.size() * sizeof(T)));
+    }
+
+    template<typename T>
+    static void read_array(std::ifstream &input, std::vector<T> &array, std::size_t n)
+    {
+        array.resize(n);
+        input.read(reinterpret_cast<char *>(array.data()), (std::streamsize) (n * sizeof(T)));
+    }
+};
+
+
+#endif //NUMERICAL_CPP_ACCEPTANCEMAP_HPP
@@ -0,0 +1,202 @@
+#ifndef NUMERICAL_CPP_ANALYTIC_HPP
+#define NUMERICAL_CPP_ANALYTIC_HPP
+
+#include "ProblemParameters.hpp"
+#include "State.hpp"
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#define NEVER std::numeric_limits<Time>::infinity()
+
+/**
+ * Exact motion in the uniform crossed fields of ProblemParameters.
+ * With w = qB/m and drift u = E/B the velocity relative to the drift rotates at w:
+ *   vy(t) = vy0 cos(wt) - c0 sin(wt)              c0 = vz0 - u
+ *   vz(t) = u + c0 cos(wt) + vy0 sin(wt)
+ *   y(t)  = y0 + (vy0 sin(wt) + c0 (cos(wt) - 1)) / w
+ *   z(t)  = z0 + u t + (c0 sin(wt) + vy0 (1 - cos(wt))) / w
+ * For B = 0 the particle is uniformly accelerated along y instead.
+ */
+class CrossedFieldSolution
+{
+public:
+    long double y0, z0, vy0, vz0;
+    long double w;      //gyration frequency
+    long double u;      //E x B drift velocity
+    long double c0;     //initial vz relative to the drift
+    long double a;      //q*E/m, only used when B = 0
+    long double R;
+    long double L;
+
+    CrossedFieldSolution(State initial, const ProblemParameters &params) : y0(initial.r.y()), z0(initial.r.z()),
+                                                                           vy0(initial.v.y()), vz0(initial.v.z()),
+                                                                           w(params.q * params.B / params.m),
+                                                                           u(params.B != 0 ? params.E / params.B : 0),
+                                                                           c0(vz0 - u),
+                                                                           a(params.q * params.E / params.m),
+                                                                           R(params.R), L(params.L)
+    {}
+
+    State at(Time t) const
+    {
+        if (w == 0)
+        {
+            return {{y0 + vy0 * t + a * t * t / 2, z0 + vz0 * t},
+                    {vy0 + a * t,                  vz0}};
+        }
+        auto s = std::sin(w * t);
+        auto c = std::cos(w * t);
+        return {{y0 + (vy0 * s + c0 * (c - 1)) / w, z0 + u * t + (c0 * s + vy0 * (1 - c)) / w},
+                {vy0 * c - c0 * s,                  u + c0 * c + vy0 * s}};
+    }
+
+    /**
+     * first t > 0 at which |y(t)| = R, NEVER if the particle never reaches the wall
+     */
+    Time wall_time() const
+    {
+        Time first = NEVER;
+        for (long double wall: {R, -R})
+        {
+            if (w == 0)
+            {
+                first = std::min(first, first_quadratic_root(a / 2, vy0, y0 - wall));
+                continue;
+            }
+
+            //y(t) = centre + amplitude * sin(wt + phase)
+            auto rho = std::hypot(vy0, c0);
+            if (rho == 0)
+            {
+                continue;
+            }
+            auto centre = y0 - c0 / w;
+            auto amplitude = rho / std::abs(w);
+            auto sine = (wall - centre) / amplitude * (w > 0 ? 1 : -1);
+            if (std::abs(sine) > 1)
+            {
+                continue;
+            }
+            auto phase = std::atan2(c0, vy0);
+            for (long double angle: {std::asin(sine), (long double) M_PI - std::asin(sine)})
+            {
+                first = std::min(first, first_positive((angle - phase) / w));
+            }
+        }
+        return first;
+    }
+
+    /**
+     * first t > 0 at which z(t) = L, NEVER if the particle never leaves the filter.
+     * z is monotone between consecutive zeros of vz, which are known in closed form,
+     * so the root is bracketed in the first monotone piece that reaches L and refined there.
+     */
+    Time exit_time() const
+    {
+        if (w == 0)
+        {
+            return vz0 > 0 ? std::max<Time>(0, (L - z0) / vz0) : NEVER;
+        }
+
+        auto rho = std::hypot(vy0, c0);
+        auto period = 2 * M_PI / std::abs(w);
+
+        //after t_max the drift has carried z past L for good (or, without drift, one period shows everything)
+        Time t_max = u > 0 ? (L - z0 + (std::abs(vy0) + rho) / std::abs(w)) / u + period : period;
+
+        std::vector<Time> bounds{0};
+        if (rho > std::abs(u))
+        {
+            //vz(t) = u + rho cos(wt - beta)
+            auto beta = std::atan2(vy0, c0);
+            auto alpha = std::acos(-u / rho);
+            for (long double angle: {beta + alpha, beta - alpha})
+            {
+                for (Time t = first_positive(angle / w); t < t_max; t += period)
+                {
+                    bounds.push_back(t);
+                }
+            }
+            std::sort(bounds.begin(), bounds.end());
+        }
+        bounds.push_back(t_max);
+
+        for (std::size_t i = 1; i < bounds.size(); i++)
+        {
+            if (at(bounds[i]).r.z() >= L)
+            {
+                return refine_exit(bounds[i - 1], bounds[i]);
+            }
+        }
+        return NEVER;
+    }
+
+private:
+    Time first_positive(Time t) const
+    {
+        auto period = 2 * M_PI / std::abs(w);
+        t = std::fmod(t, period);
+        return t <= 0 ? t + period : t;
+    }
+
+    static Time first_quadratic_root(long double A, long double B, long double C)
+    {
+        if (A == 0)
+        {
+            return (B != 0 && -C / B > 0) ? -C / B : NEVER;
+        }
+        auto discriminant = B * B - 4 * A * C;
+        if (discriminant < 0)
+        {
+            return NEVER;
+        }
+        Time first = NEVER;
+        for (long double sign: {-1.0L, 1.0L})
+        {
+            auto t = (-B + sign * std::sqrt(discriminant)) / (2 * A);
+            if (t > 0)
+            {
+                first = std::min(first, t);
+            }
+        }
+        return first;
+    }
+
+    Time refine_exit(Time lo, Time hi) const
+    {
+        //z - L goes from negative to non-negative on [lo, hi] and is monotone there:
+        //Newton steps on z' = vz, falling back to bisection whenever a step leaves the bracket
+        auto t = u > 0 ? (L - z0) / u : lo + (hi - lo) / 2;
+        if (!(t > lo && t < hi))
+        {
+            t = lo + (hi - lo) / 2;
+        }
+        for (int iteration = 0; iteration < 200; iteration++)
+        {
+            auto state = at(t);
+            auto f = state.r.z() - L;
+            if (f == 0)
+            {
+                return t;
+            }
+            (f >= 0 ? hi : lo) = t;
+            auto next = state.v.z() != 0 ? t - f / state.v.z() : lo + (hi - lo) / 2;
+            if (!(next > lo && next < hi))
+            {
+                next = lo + (hi - lo) / 2;
+            }
+            //the periodic part of z loses a few digits to cancellation, so stop at double precision
+            if (std::abs(next - t) <= std::numeric_limits<double>::epsilon() * t)
+            {
+                return next;
+            }
+            t = next;
+        }
+        return hi;
+    }
+};
+
+
+#endif //NUMERICAL_CPP_ANALYTIC_HPP
@@ -0,0 +1,112 @@
+#ifndef NUMERICAL_CPP_ARENA_HPP
+#define NUMERICAL_CPP_ARENA_HPP
+
+#include <memory_resource>
+#include <optional>
+#include <cstddef>
+#include <algorithm>
+
+#define DEFAULT_ARENA_SIZE (1 << 20)    //bytes
+#define ARENA_ALIGNMENT 64
+
+/**
+ * Monotonic memory for one run: every allocation is a pointer bump in one block, deallocation is a
+ * no-op and everything is given back at once by reset(). Allocations that do not fit go to
+ * further blocks from the heap; reset() then replaces the first block by one as large as the whole
+ * run needed, so a run that repeats an earlier one (the 53 stage-c runs) allocates nothing.
+ * Everything that lives in the arena must be destroyed before reset(). Not thread-safe: allocate
+ * from one thread, or before the worker threads start, or put a std::pmr::synchronized_pool_resource
+ * on top of it.
+ */
+class Arena : public std::pmr::memory_resource
+{
+public:
+    explicit Arena(std::size_t initial_size = DEFAULT_ARENA_SIZE) : capacity(std::max<std::size_t>(1, initial_size))
+    {
+        buffer = upstream()->allocate(capacity, ARENA_ALIGNMENT);
+        monotonic.emplace(buffer, capacity, upstream());
+    }
+
+    Arena(const Arena &) = delete;
+
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena() override
+    {
+        monotonic.reset();
+        upstream()->deallocate(buffer, capacity, ARENA_ALIGNMENT);
+    }
+
+    /**
+     * frees everything allocated since the last reset
+     */
+    void reset()
+    {
+        monotonic.reset();
+        if (used > capacity)
+        {
+            upstream()->deallocate(buffer, capacity, ARENA_ALIGNMENT);
+            capacity = used;
+            buffer = upstream()->allocate(capacity, ARENA_ALIGNMENT);
+        }
+        monotonic.emplace(buffer, capacity, upstream());
+        peak = std::max(peak, used);
+        used = 0;
+    }
+
+    //bytes handed out since the last reset, alignment padding included
+    std::size_t bytes_used() const
+    {
+        return used;
+    }
+
+    std::size_t bytes_reserved() const
+    {
+        return capacity;
+    }
+
+    std::size_t peak_bytes() const
+    {
+        return std::max(peak, used);
+    }
+
+private:
+    std::size_t capacity;
+    void *buffer = nullptr;
+    std::optional<std::pmr::monotonic_buffer_resource> monotonic;
+    std::size_t used = 0;
+    std::size_t peak = 0;
+
+    static std::pmr::memory_resource *upstream()
+    {
+        return std::pmr::new_delete_resource();
+    }
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        used += bytes + alignment - 1;
+        return monotonic->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *, std::size_t, std::size_t) override
+    {}
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+/**
+ * false for an Arena and for the standard resources that must not be shared between threads
+ */
+static bool is_thread_safe(const std::pmr::memory_resource *resource)
+{
+    return !dynamic_cast<const Arena *>(resource) &&
+           !dynamic_cast<const std::pmr::monotonic_buffer_resource *>(resource) &&
+           !dynamic_cast<const std::pmr::unsynchronized_pool_resource *>(resource);
+}
+
+
+
+#endif //NUMERICAL_CPP_ARENA_HPP
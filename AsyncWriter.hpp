@@ -0,0 +1,168 @@
+#ifndef NUMERICAL_CPP_ASYNCWRITER_HPP
+#define NUMERICAL_CPP_ASYNCWRITER_HPP
+
+#include "Output.hpp"
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+
+#define DEFAULT_QUEUE_CAPACITY 64
+#define DEFAULT_WRITE_BATCH 16
+
+/**
+ * one table waiting to be written, the format follows the extension of filename (see write_table)
+ */
+class OutputRecord
+{
+public:
+    std::string filename;
+    ColumnTable table;
+    RunInfo info;
+};
+
+/**
+ * Writes OutputRecords on a dedicated thread while the integration threads keep running.
+ * The queue holds at most `capacity` records: submit() blocks while it is full, so a slow disk
+ * slows the producers down instead of letting finished trajectories pile up in memory.
+ * The writer takes up to `batch` records per wake-up and writes them without holding the lock.
+ */
+class AsyncWriter
+{
+public:
+    explicit AsyncWriter(std::size_t capacity = DEFAULT_QUEUE_CAPACITY, std::size_t batch = DEFAULT_WRITE_BATCH)
+            : capacity(std::max<std::size_t>(1, capacity)), batch(std::max<std::size_t>(1, batch)),
+              thread([this] { write_loop(); })
+    {}
+
+    AsyncWriter(const AsyncWriter &) = delete;
+
+    AsyncWriter &operator=(const AsyncWriter &) = delete;
+
+    ~AsyncWriter()
+    {
+        close();
+    }
+
+    /**
+     * queues a record, waiting for room if the writer is behind. safe to call from any thread.
+     * throws std::logic_error once the writer is closed, also to a submit still waiting for room.
+     */
+    void submit(OutputRecord record)
+    {
+        std::unique_lock lock(mutex);
+        if (queue.size() >= capacity && !closed)
+        {
+            stalls++;
+            not_full.wait(lock, [this] { return queue.size() < capacity || closed; });
+        }
+        if (closed)
+        {
+            throw std::logic_error("AsyncWriter: " + record.filename + " submitted after close()");
+        }
+        queue.push_back(std::move(record));
+        peak = std::max(peak, queue.size());
+        not_empty.notify_one();
+    }
+
+    /**
+     * blocks until every record submitted so far is on disk, or the writer thread has stopped
+     */
+    void flush()
+    {
+        std::unique_lock lock(mutex);
+        drained.wait(lock, [this] { return (queue.empty() && in_flight == 0) || stopped; });
+    }
+
+    /**
+     * writes what is left and stops the writer thread
+     */
+    void close()
+    {
+        {
+            std::lock_guard lock(mutex);
+            if (closed)
+            {
+                return;
+            }
+            closed = true;
+        }
+        not_empty.notify_one();
+        not_full.notify_all();
+        thread.join();
+    }
+
+    std::size_t written() const
+    {
+        std::lock_guard lock(mutex);
+        return n_written;
+    }
+
+    //largest queue length seen and number of submits that had to wait for room
+    std::pair<std::size_t, std::size_t> pressure() const
+    {
+        std::lock_guard lock(mutex);
+        return {peak, stalls};
+    }
+
+private:
+    std::size_t capacity;
+    std::size_t batch;
+    mutable std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::condition_variable drained;
+    std::deque<OutputRecord> queue;
+    std::size_t in_flight = 0;
+    std::size_t n_written = 0;
+    std::size_t peak = 0;
+    std::size_t stalls = 0;
+    bool closed = false;
+    bool stopped = false;
+    std::thread thread;     //last member, so everything above exists when it starts
+
+    void write_loop()
+    {
+        std::vector<OutputRecord> taken;
+        while (true)
+        {
+            {
+                std::unique_lock lock(mutex);
+                not_empty.wait(lock, [this] { return !queue.empty() || closed; });
+                if (queue.empty())
+                {
+                    stopped = true;
+                    drained.notify_all();
+                    return;
+                }
+                while (!queue.empty() && taken.size() < batch)
+                {
+                    taken.push_back(std::move(queue.front()));
+                    queue.pop_front();
+                }
+                in_flight = taken.size();
+            }
+            not_full.notify_all();
+
+            for (const auto &record: taken)
+            {
+                write_table(record.filename, record.table, record.info);
+            }
+
+            {
+                std::lock_guard lock(mutex);
+                n_written += taken.size();
+                in_flight = 0;
+            }
+            taken.clear();
+            drained.notify_all();
+        }
+    }
+};
+
+
+#endif //NUMERICAL_CPP_ASYNCWRITER_HPP
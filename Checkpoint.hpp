@@ -0,0 +1,212 @@
+#ifndef NUMERICAL_CPP_CHECKPOINT_HPP
+#define NUMERICAL_CPP_CHECKPOINT_HPP
+
+#include "State.hpp"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <exception>
+#include <filesystem>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <iterator>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define CHECKPOINT_MAGIC "WFCKPT1"
+#define CHECKPOINT_VERSION 2
+#define DEFAULT_CHECKPOINT_SECONDS 600
+#define DEFAULT_SLICE_STEPS (1ul << 20)     //steps a particle takes before the run checks the checkpoint clock
+
+/**
+ * native-endian byte image of a run, see Simulation::checkpoint. values are stored bit for bit,
+ * so a run restored from it continues exactly as the original would have.
+ */
+class ByteWriter
+{
+public:
+    std::vector<char> bytes;
+
+    template<typename T>
+    void put(const T &value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        auto first = reinterpret_cast<const char *>(&value);
+        bytes.insert(bytes.end(), first, first + sizeof(T));
+    }
+
+    void put(const State &state)
+    {
+        put(state.r.y());
+        put(state.r.z());
+        put(state.v.y());
+        put(state.v.z());
+    }
+};
+
+class ByteReader
+{
+public:
+    explicit ByteReader(const std::vector<char> &bytes) : bytes(bytes)
+    {}
+
+    template<typename T>
+    T get()
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (position + sizeof(T) > bytes.size())
+        {
+            throw std::runtime_error("checkpoint is truncated");
+        }
+        T value;
+        std::memcpy(&value, bytes.data() + position, sizeof(T));
+        position += sizeof(T);
+        return value;
+    }
+
+    State get_state()
+    {
+        State state;
+        state.r.y() = get<long double>();
+        state.r.z() = get<long double>();
+        state.v.y() = get<long double>();
+        state.v.z() = get<long double>();
+        return state;
+    }
+
+private:
+    const std::vector<char> &bytes;
+    std::size_t position = 0;
+};
+
+/**
+ * Writes checkpoint images on a background thread while the run goes on. Every image goes to
+ * <filename>.tmp first and is renamed over <filename> only once it is complete and synced to the
+ * device, so the file always holds the last complete checkpoint, whenever the process dies or the
+ * machine loses power. At most one write is in flight; write() waits for the previous one.
+ */
+class CheckpointWriter
+{
+public:
+    explicit CheckpointWriter(std::string filename) : filename(std::move(filename))
+    {}
+
+    CheckpointWriter(const CheckpointWriter &) = delete;
+
+    CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+    ~CheckpointWriter()
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+    void write(std::vector<char> image)
+    {
+        wait();
+        thread = std::thread([this, image = std::move(image)] {
+            try
+            {
+                auto temporary = filename + ".tmp";
+                write_synced(temporary, image);
+                std::filesystem::rename(temporary, filename);
+                //the rename itself is only durable once the directory entry is on disk
+                auto directory = std::filesystem::absolute(filename).parent_path();
+                int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+                if (fd >= 0)
+                {
+                    ::fsync(fd);
+                    ::close(fd);
+                }
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+        });
+    }
+
+    /**
+     * blocks until the last write is on disk, rethrows its error if it failed
+     */
+    void wait()
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+        if (error)
+        {
+            std::rethrow_exception(std::exchange(error, nullptr));
+        }
+    }
+
+    /**
+     * waits for the last write and deletes the checkpoint, for a run that has finished, together
+     * with a temporary left by a write that was interrupted
+     */
+    void remove()
+    {
+        wait();
+        std::filesystem::remove(filename);
+        std::filesystem::remove(filename + ".tmp");
+    }
+
+private:
+    std::string filename;
+    std::thread thread;
+    std::exception_ptr error;
+
+    /**
+     * writes the whole image and waits until it is on the device, so a crash after the rename can
+     * not leave an empty or partial checkpoint behind
+     */
+    static void write_synced(const std::string &path, const std::vector<char> &image)
+    {
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            throw std::runtime_error("cannot write " + path);
+        }
+        std::size_t written = 0;
+        while (written < image.size())
+        {
+            auto n = ::write(fd, image.data() + written, image.size() - written);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                ::close(fd);
+                throw std::runtime_error("cannot write " + path);
+            }
+            written += (std::size_t) n;
+        }
+        bool synced = ::fsync(fd) == 0;
+        if (::close(fd) != 0 || !synced)
+        {
+            throw std::runtime_error("cannot write " + path);
+        }
+    }
+};
+
+static std::vector<char> read_checkpoint(const std::string &filename)
+{
+    std::ifstream input(filename, std::ios::binary);
+    if (!input)
+    {
+        throw std::runtime_error("cannot open checkpoint " + filename);
+    }
+    return {std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
+}
+
+
+#endif //NUMERICAL_CPP_CHECKPOINT_HPP
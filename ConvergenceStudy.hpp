@@ -0,0 +1,249 @@
+#ifndef NUMERICAL_CPP_CONVERGENCESTUDY_HPP
+#define NUMERICAL_CPP_CONVERGENCESTUDY_HPP
+
+#include "Particle.hpp"
+#include "Analytic.hpp"
+#include "Scheduler.hpp"
+#include "Output.hpp"
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#define MAX_LEVELS 40
+#define LEVEL_CHUNK_STEPS (1 << 20)     //steps between two looks at the stop flag and the clock
+#define ROUNDOFF_RATIO 1.5              //an error that shrinks by less than this per halving has hit the floor
+#define DEFAULT_TIME_BUDGET 60          //seconds
+
+class ConvergenceLevel
+{
+public:
+    std::size_t level;
+    long double dt;
+    std::size_t steps;
+    bool done = false;
+    long double error = 0;          //distance to the exact final position
+    Vector2 position;
+    double seconds = 0;
+    long double observed_order = 0; //from this level and the previous one
+    long double richardson_estimate = 0;    //error estimate from the last two levels alone
+    long double extrapolated_error = 0;     //error of the Richardson-extrapolated position
+
+    ConvergenceLevel(std::size_t level, long double dt, std::size_t steps) : level(level), dt(dt), steps(steps)
+    {}
+};
+
+/**
+ * Convergence of a fixed-step method on one particle: level k takes base_steps * 2^k steps of
+ * T / (base_steps * 2^k), so every level ends exactly at T and only the final state is kept.
+ * Levels are claimed in order by n_threads workers and run concurrently. No new level starts
+ * once two consecutive levels stop improving (the round-off floor) or once the measured cost per
+ * step says it would not finish within the time budget; levels still running when the budget
+ * runs out are abandoned.
+ */
+class ConvergenceStudy
+{
+public:
+    ProblemParameters params;
+    State initial;
+    std::size_t base_steps;
+    unsigned n_threads = 0;         //0 means one thread per core
+    double time_budget = DEFAULT_TIME_BUDGET;
+    std::vector<ConvergenceLevel> levels;
+    long double order = 0;          //observed order of accuracy in the asymptotic range
+    std::size_t floor_level = MAX_LEVELS;
+
+    ConvergenceStudy(const ProblemParameters &params, State initial, long double dt0)
+            : params(params), initial(initial),
+              base_steps(std::max<std::size_t>(1, (std::size_t) std::ceil(params.T / dt0)))
+    {
+        //the levels halve dt, which the closed form and the adaptive method ignore
+        if (params.method == ANALYTIC || params.method == DORMAND_PRINCE)
+        {
+            throw std::invalid_argument("a convergence study needs a fixed-step method, not " +
+                                        method_name(params.method));
+        }
+        this->params.record = FINAL_ONLY;
+    }
+
+    void run()
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start + std::chrono::duration<double>(time_budget);
+        auto exact = CrossedFieldSolution(initial, params).at(params.T).r;
+
+        levels.clear();
+        for (std::size_t k = 0; k < MAX_LEVELS; k++)
+        {
+            auto steps = base_steps << k;
+            levels.emplace_back(k, params.T / steps, steps);
+        }
+
+        std::mutex mutex;
+        std::atomic<std::size_t> next{0};
+        std::atomic<bool> stop{false};
+        double seconds_per_step = 0;
+
+        auto worker = [&] {
+            while (!stop)
+            {
+                std::size_t k = next++;
+                if (k >= levels.size())
+                {
+                    return;
+                }
+                auto &level = levels[k];
+                {
+                    std::lock_guard lock(mutex);
+                    auto remaining = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+                    if (stop || (seconds_per_step > 0 && seconds_per_step * level.steps > remaining))
+                    {
+                        stop = true;
+                        return;
+                    }
+                }
+
+                auto level_params = params;
+                level_params.dt = level.dt;
+                Particle particle(initial, &level_params);
+                auto level_start = std::chrono::steady_clock::now();
+                for (std::size_t first = 0; first < level.steps; first += LEVEL_CHUNK_STEPS)
+                {
+                    if (stop || std::chrono::steady_clock::now() > deadline)
+                    {
+                        stop = true;
+                        return;
+                    }
+                    particle.run_steps(first, std::min<std::size_t>(LEVEL_CHUNK_STEPS, level.steps - first));
+                }
+
+                std::lock_guard lock(mutex);
+                level.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - level_start).count();
+                level.position = particle.state.r;
+                level.error = distance(level.position, exact);
+                level.done = true;
+                seconds_per_step = std::max(seconds_per_step, level.seconds / level.steps);
+                if (reached_floor())
+                {
+                    stop = true;
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < resolve_thread_count(n_threads); i++)
+        {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto &thread: threads)
+        {
+            thread.join();
+        }
+
+        //keep the completed prefix only, a level finished after an abandoned one has no neighbour to compare to
+        std::size_t n_done = 0;
+        while (n_done < levels.size() && levels[n_done].done)
+        {
+            n_done++;
+        }
+        levels.erase(levels.begin() + (std::ptrdiff_t) n_done, levels.end());
+        reached_floor();
+        fit(exact);
+    }
+
+    /**
+     * level, dt, steps, error, observed order, Richardson estimate and extrapolated error of every level
+     */
+    void write_errors(const std::string &filename) const
+    {
+        CsvWriter csv(filename);
+        csv.line({"level", "dt", "steps", "error", "observed_order", "richardson_estimate", "extrapolated_error",
+                  "seconds"});
+        for (const auto &level: levels)
+        {
+            csv.field(level.level);
+            csv.field((double) level.dt);
+            csv.field(level.steps);
+            csv.field((double) level.error);
+            csv.field((double) level.observed_order);
+            csv.field((double) level.richardson_estimate);
+            csv.field((double) level.extrapolated_error);
+            csv.field(level.seconds, true);
+        }
+    }
+
+private:
+    static long double distance(const Vector2 &a, const Vector2 &b)
+    {
+        return (a - b).norm();
+    }
+
+    /**
+     * looks at the completed prefix of levels; sets floor_level at the first of two consecutive
+     * levels that did not improve by ROUNDOFF_RATIO
+     */
+    bool reached_floor()
+    {
+        for (std::size_t k = 2; k < levels.size() && levels[k].done && levels[k - 1].done && levels[k - 2].done; k++)
+        {
+            if (levels[k - 1].error * ROUNDOFF_RATIO > levels[k - 2].error &&
+                levels[k].error * ROUNDOFF_RATIO > levels[k - 1].error)
+            {
+                floor_level = k - 1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void fit(const Vector2 &exact)
+    {
+        for (std::size_t k = 1; k < levels.size(); k++)
+        {
+            if (levels[k].error > 0 && levels[k - 1].error > 0)
+            {
+                levels[k].observed_order = std::log2(levels[k - 1].error / levels[k].error);
+            }
+        }
+
+        //median of the level-to-level orders up to the first level that did not improve:
+        //the last levels before the floor are already partly round-off, the median ignores them
+        std::vector<long double> orders;
+        for (std::size_t k = 1; k < levels.size() && levels[k].error * ROUNDOFF_RATIO <= levels[k - 1].error; k++)
+        {
+            orders.push_back(levels[k].observed_order);
+        }
+        order = 0;
+        if (!orders.empty())
+        {
+            std::sort(orders.begin(), orders.end());
+            order = orders.size() % 2 ? orders[orders.size() / 2]
+                                      : (orders[orders.size() / 2 - 1] + orders[orders.size() / 2]) / 2;
+        }
+
+        for (std::size_t k = 1; k < levels.size(); k++)
+        {
+            auto &level = levels[k];
+            const auto &coarse = levels[k - 1];
+            if (order > 0)
+            {
+                //x_fine + (x_fine - x_coarse) / (2^p - 1)
+                auto factor = 1 / (std::pow(2.0L, order) - 1);
+                auto difference = level.position - coarse.position;
+                auto extrapolated = level.position + factor * difference;
+                level.richardson_estimate = factor * difference.norm();
+                level.extrapolated_error = distance(extrapolated, exact);
+            }
+        }
+    }
+};
+
+
+#endif //NUMERICAL_CPP_CONVERGENCESTUDY_HPP
@@ -0,0 +1,612 @@
+#ifndef NUMERICAL_CPP_ENSEMBLE_HPP
+#define NUMERICAL_CPP_ENSEMBLE_HPP
+
+#include "Particle.hpp"
+#include "ProblemParameters.hpp"
+#include "Scheduler.hpp"
+#include "Events.hpp"
+#include "RungeKutta.hpp"
+#include "Precision.hpp"
+#include "FieldMap.hpp"
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <limits>
+#include <memory_resource>
+
+#define ENSEMBLE_ALIGNMENT 64     //bytes, one cache line / one AVX-512 register
+#define DEFAULT_COMPACTION_INTERVAL 8
+
+/**
+ * ENSEMBLE_ALIGNMENT-aligned storage from the heap or, if given, from a memory resource such as an Arena
+ */
+template<typename T>
+class AlignedAllocator
+{
+public:
+    typedef T value_type;
+
+    std::pmr::memory_resource *resource = nullptr;
+
+    AlignedAllocator() = default;
+
+    explicit AlignedAllocator(std::pmr::memory_resource *resource) : resource(resource)
+    {}
+
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U> &other) : resource(other.resource)
+    {}
+
+    T *allocate(std::size_t n)
+    {
+        if (resource)
+        {
+            return static_cast<T *>(resource->allocate(n * sizeof(T), ENSEMBLE_ALIGNMENT));
+        }
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(ENSEMBLE_ALIGNMENT)));
+    }
+
+    void deallocate(T *p, std::size_t n)
+    {
+        if (resource)
+        {
+            resource->deallocate(p, n * sizeof(T), ENSEMBLE_ALIGNMENT);
+            return;
+        }
+        ::operator delete(p, std::align_val_t(ENSEMBLE_ALIGNMENT));
+    }
+
+    template<typename U>
+    friend bool operator==(const AlignedAllocator &a, const AlignedAllocator<U> &b)
+    {
+        return a.resource == b.resource;
+    }
+};
+
+/**
+ * Structure-of-arrays storage for a whole particle ensemble.
+ * y, z, vy, vz of all particles live in separate aligned columns, so a block of
+ * consecutive particles is loaded into one SIMD register per coordinate and
+ * advanced together (AVX2: 4 lanes, AVX-512: 8 lanes of double).
+ * Real is the precision of the stored state and of every kernel operation, see LanePolicy.
+ */
+template<typename Real>
+class BasicEnsemble
+{
+public:
+    typedef LanePolicy<Real> Policy;
+    typedef typename Policy::Lanes Lanes;
+    typedef typename Policy::Mask LaneMask;
+    typedef std::vector<Real, AlignedAllocator<Real>> Column;
+    typedef std::vector<unsigned char, AlignedAllocator<unsigned char>> Flags;
+
+    static constexpr std::size_t lanes = Policy::size;
+
+    struct Coefficients
+    {
+        Real kE;      //q*E/m
+        Real kB;      //q*B/m
+        Real dt;
+        Real R;
+        Real L;
+        Real factor;                //q/m, for the fields of a map
+        const FieldMap *fields;     //E(y, z) and B(y, z) instead of the uniform E and B, see fields_at
+    };
+
+    std::size_t size;
+    std::size_t padded_size;
+    Column y;
+    Column z;
+    Column vy;
+    Column vz;
+    Column t;
+    Flags crashed;
+    Flags passed;
+    ProblemParameters *params;
+    unsigned long crash_counter = 0;
+    std::size_t compaction_interval = DEFAULT_COMPACTION_INTERVAL;    //steps between compactions, 0 disables
+
+    /**
+     * the columns come from `memory` if given (e.g. the arena of a Simulation), otherwise from the heap
+     */
+    BasicEnsemble(std::size_t n_particles, ProblemParameters *params, std::pmr::memory_resource *memory = nullptr)
+            : size(n_particles), padded_size((n_particles + lanes - 1) / lanes * lanes),
+              y(padded_size, AlignedAllocator<Real>(memory)), z(padded_size, AlignedAllocator<Real>(memory)),
+              vy(padded_size, AlignedAllocator<Real>(memory)), vz(padded_size, AlignedAllocator<Real>(memory)),
+              t(padded_size, AlignedAllocator<Real>(memory)),
+              crashed(padded_size, AlignedAllocator<unsigned char>(memory)),
+              passed(padded_size, AlignedAllocator<unsigned char>(memory)), params(params)
+    {}
+
+    /**
+     * reuses the columns for another run of n_particles with other parameters.
+     * nothing is reallocated as long as n_particles fits in what the ensemble already holds.
+     */
+    void reset(std::size_t n_particles, ProblemParameters *new_params)
+    {
+        size = n_particles;
+        padded_size = (n_particles + lanes - 1) / lanes * lanes;
+        for (auto *column: {&y, &z, &vy, &vz, &t})
+        {
+            column->assign(padded_size, Real(0));
+        }
+        crashed.assign(padded_size, 0);
+        passed.assign(padded_size, 0);
+        params = new_params;
+        crash_counter = 0;
+    }
+
+    void set(std::size_t i, State s)
+    {
+        y[i] = (Real) s.r.y();
+        z[i] = (Real) s.r.z();
+        vy[i] = (Real) s.v.y();
+        vz[i] = (Real) s.v.z();
+    }
+
+    State get(std::size_t i) const
+    {
+        return {{(long double) y[i],  (long double) z[i]},
+                {(long double) vy[i], (long double) vz[i]}};
+    }
+
+    Coefficients coefficients() const
+    {
+        auto factor = params->q / params->m;
+        return {(Real) (factor * params->E), (Real) (factor * params->B), (Real) params->dt,
+                (Real) params->R, (Real) params->L, (Real) factor, params->fields};
+    }
+
+    /**
+     * q/m E and q/m B at the lanes' positions: the uniform coefficients, or the interpolation of the
+     * field map in the same arithmetic as FieldMap::operator() does it for one particle. the grid
+     * coordinates, weights and blends are lane operations; only the surrounding nodes (4 for
+     * bilinear, 16 for bicubic, mostly in one tile) are gathered lane by lane.
+     */
+    template<bool mapped>
+    static void fields_at(const Lanes &y, const Lanes &z, const Coefficients &c, Lanes &kE, Lanes &kB)
+    {
+        if constexpr (!mapped)
+        {
+            kE = c.kE;
+            kB = c.kB;
+        }
+        else
+        {
+            const auto &map = *c.fields;
+            //cell of every lane and the offset in it, clamped to the grid as in FieldMap::locate
+            auto fy = Policy::min(Policy::max((y - Real(map.y0)) / Real(map.dy), Lanes(Real(0))),
+                                  Lanes(Real((double) (map.ny - 1))));
+            auto fz = Policy::min(Policy::max((z - Real(map.z0)) / Real(map.dz), Lanes(Real(0))),
+                                  Lanes(Real((double) (map.nz - 1))));
+            std::array<std::size_t, lanes> i, j;
+            for (std::size_t lane = 0; lane < lanes; lane++)
+            {
+                i[lane] = std::min((std::size_t) (double) lane_of(fy, lane), map.ny - 2);
+                j[lane] = std::min((std::size_t) (double) lane_of(fz, lane), map.nz - 2);
+            }
+            Lanes ty = fy - Policy::generate([&](std::size_t lane) { return (double) i[lane]; });
+            Lanes tz = fz - Policy::generate([&](std::size_t lane) { return (double) j[lane]; });
+            Lanes E = Real(0), B = Real(0);
+
+            if (map.interpolation == BICUBIC)
+            {
+                Lanes wy[4], wz[4];
+                FieldMap::cubic_weights<Lanes, Real>(ty, wy);
+                FieldMap::cubic_weights<Lanes, Real>(tz, wz);
+                for (int a = 0; a < 4; a++)
+                {
+                    Lanes rowE = Real(0), rowB = Real(0);
+                    for (int b = 0; b < 4; b++)
+                    {
+                        std::array<const FieldMap::Node *, lanes> node;
+                        for (std::size_t lane = 0; lane < lanes; lane++)
+                        {
+                            auto ia = (std::size_t) std::clamp<long>((long) i[lane] + a - 1, 0, (long) map.ny - 1);
+                            auto jb = (std::size_t) std::clamp<long>((long) j[lane] + b - 1, 0, (long) map.nz - 1);
+                            node[lane] = &map.at(ia, jb);
+                        }
+                        rowE += wz[b] * Policy::generate([&](std::size_t lane) { return node[lane]->E; });
+                        rowB += wz[b] * Policy::generate([&](std::size_t lane) { return node[lane]->B; });
+                    }
+                    E += wy[a] * rowE;
+                    B += wy[a] * rowB;
+                }
+            }
+            else
+            {
+                //the corners of the cell, lane by lane
+                std::array<const FieldMap::Node *, lanes> n00, n01, n10, n11;
+                for (std::size_t lane = 0; lane < lanes; lane++)
+                {
+                    n00[lane] = &map.at(i[lane], j[lane]);
+                    n01[lane] = &map.at(i[lane], j[lane] + 1);
+                    n10[lane] = &map.at(i[lane] + 1, j[lane]);
+                    n11[lane] = &map.at(i[lane] + 1, j[lane] + 1);
+                }
+                auto gather = [](const std::array<const FieldMap::Node *, lanes> &node, double FieldMap::Node::*component) {
+                    return Policy::generate([&](std::size_t lane) { return node[lane]->*component; });
+                };
+                Lanes w00 = (Real(1) - ty) * (Real(1) - tz), w01 = (Real(1) - ty) * tz;
+                Lanes w10 = ty * (Real(1) - tz), w11 = ty * tz;
+                E = w00 * gather(n00, &FieldMap::Node::E) + w01 * gather(n01, &FieldMap::Node::E) +
+                    w10 * gather(n10, &FieldMap::Node::E) + w11 * gather(n11, &FieldMap::Node::E);
+                B = w00 * gather(n00, &FieldMap::Node::B) + w01 * gather(n01, &FieldMap::Node::B) +
+                    w10 * gather(n10, &FieldMap::Node::B) + w11 * gather(n11, &FieldMap::Node::B);
+            }
+            kE = c.factor * E;
+            kB = c.factor * B;
+        }
+    }
+
+    /**
+     * one step of the chosen method for every lane of a block, in uniform fields or in the field map.
+     * Runge-Kutta methods go through the tableau engine on the whole (y, z, vy, vz) vector of lanes.
+     */
+    template<METHOD method, bool mapped>
+    static void step(Lanes &y, Lanes &z, Lanes &vy, Lanes &vz, const Coefficients &c)
+    {
+        if constexpr (MethodTableau<method>::exists)
+        {
+            auto x = rk_step<MethodTableau<method>::tableau>(PhaseVector<Lanes>{y, z, vy, vz}, c.dt,
+                                                            [&](const PhaseVector<Lanes> &x) -> PhaseVector<Lanes> {
+                                                                Lanes kE, kB;
+                                                                fields_at<mapped>(x[0], x[1], c, kE, kB);
+                                                                return {x[2], x[3], kE - kB * x[3], kB * x[2]};
+                                                            });
+            y = x[0];
+            z = x[1];
+            vy = x[2];
+            vz = x[3];
+        }
+        else if constexpr (method == BORIS)
+        {
+            Lanes kE, kB;
+            fields_at<mapped>(y, z, c, kE, kB);
+            Lanes kick = Real(0.5) * c.dt * kE;
+            Lanes tangent = Real(0.5) * c.dt * kB;
+            Lanes sine = Real(2) * tangent / (Real(1) + tangent * tangent);
+
+            vy += kick;
+            auto vy_prime = vy - tangent * vz;
+            auto vz_prime = vz + tangent * vy;
+            vy -= sine * vz_prime;
+            vz += sine * vy_prime;
+            vy += kick;
+
+            y += c.dt * vy;
+            z += c.dt * vz;
+        }
+    }
+
+    /**
+     * exact crossing inside the step of one lane that went from (y, z, vy, vz) to (ny, nz, nvy, nvz),
+     * the same test as Particle::check_boundaries. if there is one, the lane's new state is replaced
+     * by the interpolated state at the crossing.
+     */
+    static Crossing refine_lane(const Lanes &y, const Lanes &z, const Lanes &vy, const Lanes &vz,
+                                Lanes &ny, Lanes &nz, Lanes &nvy, Lanes &nvz, std::size_t lane, const Coefficients &c)
+    {
+        auto derivative = [&](const StateVector &x) -> StateVector {
+            long double kE = (long double) c.kE, kB = (long double) c.kB;
+            if (c.fields)
+            {
+                auto field = (*c.fields)(x[0], x[1]);
+                kE = (long double) c.factor * field.E;
+                kB = (long double) c.factor * field.B;
+            }
+            return {x[2], x[3], kE - kB * x[3], kB * x[2]};
+        };
+        auto element = [lane](const Lanes &x) {
+            return (long double) lane_of(x, lane);
+        };
+        StateVector x0{element(y), element(z), element(vy), element(vz)};
+        StateVector x1{element(ny), element(nz), element(nvy), element(nvz)};
+        StepInterpolant step(x0, derivative(x0), x1, derivative(x1), (long double) c.dt);
+        auto crossing = locate_crossing(step, (long double) c.R, (long double) c.L);
+        if (crossing.found)
+        {
+            auto x = step(crossing.s);
+            set_lane(ny, lane, (Real) x[0]);
+            set_lane(nz, lane, (Real) x[1]);
+            set_lane(nvy, lane, (Real) x[2]);
+            set_lane(nvz, lane, (Real) x[3]);
+        }
+        else
+        {
+            //the endpoint test and the interpolant agree at the end of the step, so this is only rounding
+            bool wall = std::abs(x1[0]) >= (long double) c.R && x1[1] <= (long double) c.L;
+            bool exit = !wall && x1[1] > (long double) c.L;
+            crossing = {wall || exit, wall, 1};
+        }
+        return crossing;
+    }
+
+    /**
+     * stage c of one block for at most max_steps steps. lanes that crash or pass leave `active`,
+     * keep their final state and are marked in block_crashed / block_passed.
+     */
+    template<METHOD method, bool mapped>
+    void advance_block(Lanes &by, Lanes &bz, Lanes &bvy, Lanes &bvz, Lanes &steps, LaneMask &active,
+                       LaneMask &block_crashed, LaneMask &block_passed, const Coefficients &c,
+                       std::size_t max_steps) const
+    {
+        for (std::size_t k = 0; k < max_steps && Policy::any(active); k++)
+        {
+            auto ny = by, nz = bz, nvy = bvy, nvz = bvz;
+            step<method, mapped>(ny, nz, nvy, nvz, c);
+
+            //branchless crash / pass test over the whole block
+            LaneMask hit_wall = active && (Policy::abs(ny) >= c.R) && (nz <= c.L);
+            LaneMask hit_exit = active && !hit_wall && (nz > c.L);
+
+            //lanes that may finish in this step are refined before the step is committed. a lane can
+            //also leave and come back within the step: the Hermite interpolant of y stays within
+            //max(|y0|, |y1|) + 4/27 dt (|vy0| + |vy1|), likewise for z, so only lanes where that bound
+            //reaches the wall or the exit can cross, and every lane that ends outside is among them
+            if (params->locate_events)
+            {
+                Real reach = Real(4) / Real(27) * c.dt;
+                LaneMask near = active && ((Policy::max(Policy::abs(by), Policy::abs(ny)) +
+                                            reach * (Policy::abs(bvy) + Policy::abs(nvy)) >= c.R) ||
+                                           (Policy::max(bz, nz) + reach * (Policy::abs(bvz) + Policy::abs(nvz)) >
+                                            c.L));
+                if (Policy::any(near))
+                {
+                    for (std::size_t lane = 0; lane < lanes; lane++)
+                    {
+                        if (lane_of(near, lane))
+                        {
+                            auto crossing = refine_lane(by, bz, bvy, bvz, ny, nz, nvy, nvz, lane, c);
+                            set_lane(hit_wall, lane, crossing.found && crossing.crashed);
+                            set_lane(hit_exit, lane, crossing.found && !crossing.crashed);
+                            if (crossing.found)
+                            {
+                                set_lane(steps, lane, lane_of(steps, lane) + Real(crossing.s - 1));
+                            }
+                        }
+                    }
+                }
+            }
+
+            //finished lanes keep their final state
+            Policy::blend(active, by, ny);
+            Policy::blend(active, bz, nz);
+            Policy::blend(active, bvy, nvy);
+            Policy::blend(active, bvz, nvz);
+            Policy::blend(active, steps, steps + Real(1));
+
+            block_crashed = block_crashed || hit_wall;
+            block_passed = block_passed || hit_exit;
+            active = active && !(hit_wall || hit_exit);
+        }
+    }
+
+    /**
+     * advances the blocks [first_block, last_block) and returns how many of their particles crashed
+     */
+    template<METHOD method, bool mapped>
+    unsigned long run_blocks(char stage, std::size_t first_block, std::size_t last_block)
+    {
+        const auto c = coefficients();
+        const Lanes index = Policy::iota();
+        unsigned long crashes = 0;
+
+        for (std::size_t base = first_block * lanes; base < last_block * lanes; base += lanes)
+        {
+            Lanes by = Policy::load(&y[base]);
+            Lanes bz = Policy::load(&z[base]);
+            Lanes bvy = Policy::load(&vy[base]);
+            Lanes bvz = Policy::load(&vz[base]);
+            Lanes steps = Real(0);
+            LaneMask block_crashed(false);
+            LaneMask block_passed(false);
+
+            if (stage == 'b')
+            {
+                for (Time time = params->dt; time < params->T; time += params->dt)
+                {
+                    step<method, mapped>(by, bz, bvy, bvz, c);
+                    steps += Real(1);
+                }
+            }
+            else if (stage == 'c')
+            {
+                //padding lanes past the end of the ensemble start out finished
+                LaneMask active = index < Real((double) std::min(lanes, size - std::min(size, base)));
+                advance_block<method, mapped>(by, bz, bvy, bvz, steps, active, block_crashed, block_passed, c,
+                                      std::numeric_limits<std::size_t>::max());
+            }
+
+            Policy::store(by, &y[base]);
+            Policy::store(bz, &z[base]);
+            Policy::store(bvy, &vy[base]);
+            Policy::store(bvz, &vz[base]);
+            Policy::store(steps * c.dt, &t[base]);
+            for (std::size_t lane = 0; lane < lanes; lane++)
+            {
+                crashed[base + lane] = lane_of(block_crashed, lane);
+                passed[base + lane] = lane_of(block_passed, lane);
+            }
+            crashes += Policy::count(block_crashed);
+        }
+        return crashes;
+    }
+
+    /**
+     * stage c of particles [first_block * lanes, last_block * lanes) with stream compaction.
+     * the live particles are copied into a private working set and stepped in lockstep, block by
+     * block, compaction_interval steps at a time. after every round the finished ones are retired
+     * to the ensemble columns (final state, time, crash / pass flag) and the others are packed to
+     * the front, so the next round steps ceil(live / lanes) blocks instead of every block until its
+     * slowest lane is done. every particle takes exactly the steps it takes in run_blocks.
+     */
+    template<METHOD method, bool mapped>
+    unsigned long run_compacted(std::size_t first_block, std::size_t last_block)
+    {
+        const auto c = coefficients();
+        const Lanes index = Policy::iota();
+        std::size_t first = first_block * lanes;
+        std::size_t live = std::min(last_block * lanes, size) - std::min(first, size);
+        unsigned long crashes = 0;
+
+        std::size_t padded = (live + lanes - 1) / lanes * lanes;
+        Column wy(padded), wz(padded), wvy(padded), wvz(padded), wsteps(padded);
+        std::vector<std::size_t> id(padded);
+        for (std::size_t i = 0; i < live; i++)
+        {
+            wy[i] = y[first + i];
+            wz[i] = z[first + i];
+            wvy[i] = vy[first + i];
+            wvz[i] = vz[first + i];
+            id[i] = first + i;
+        }
+
+        while (live > 0)
+        {
+            std::size_t kept = 0;
+            for (std::size_t base = 0; base < live; base += lanes)
+            {
+                Lanes by = Policy::load(&wy[base]);
+                Lanes bz = Policy::load(&wz[base]);
+                Lanes bvy = Policy::load(&wvy[base]);
+                Lanes bvz = Policy::load(&wvz[base]);
+                Lanes steps = Policy::load(&wsteps[base]);
+                std::size_t n = std::min(lanes, live - base);
+                LaneMask active = index < Real((double) n);
+                LaneMask block_crashed(false);
+                LaneMask block_passed(false);
+                advance_block<method, mapped>(by, bz, bvy, bvz, steps, active, block_crashed, block_passed, c,
+                                      compaction_interval);
+                Policy::store(by, &wy[base]);
+                Policy::store(bz, &wz[base]);
+                Policy::store(bvy, &wvy[base]);
+                Policy::store(bvz, &wvz[base]);
+                Policy::store(steps, &wsteps[base]);
+
+                //kept never passes base + lane, so packing in place only overwrites processed entries
+                for (std::size_t lane = 0; lane < n; lane++)
+                {
+                    auto i = base + lane;
+                    if (lane_of(active, lane))
+                    {
+                        wy[kept] = wy[i];
+                        wz[kept] = wz[i];
+                        wvy[kept] = wvy[i];
+                        wvz[kept] = wvz[i];
+                        wsteps[kept] = wsteps[i];
+                        id[kept] = id[i];
+                        kept++;
+                        continue;
+                    }
+                    auto j = id[i];
+                    y[j] = wy[i];
+                    z[j] = wz[i];
+                    vy[j] = wvy[i];
+                    vz[j] = wvz[i];
+                    t[j] = wsteps[i] * c.dt;
+                    crashed[j] = lane_of(block_crashed, lane);
+                    passed[j] = lane_of(block_passed, lane);
+                    crashes += crashed[j];
+                }
+            }
+            //lanes past `live` in the last block hold stale entries, they start the next round inactive
+            live = kept;
+        }
+        return crashes;
+    }
+
+    /**
+     * methods without a SIMD kernel (closed-form, adaptive) go particle by particle over the same columns
+     */
+    unsigned long run_scalar(char stage, std::size_t first_block, std::size_t last_block)
+    {
+        unsigned long crashes = 0;
+        for (std::size_t i = first_block * lanes; i < std::min(last_block * lanes, size); i++)
+        {
+            Particle particle(get(i), params);
+            crashes += particle.run(stage);
+            set(i, particle.state);
+            t[i] = (Real) particle.time;
+            crashed[i] = particle.crashed;
+            passed[i] = particle.passed;
+        }
+        return crashes;
+    }
+
+    //stage c compacts the live particles; stage b has no early finishers, and one lane has nothing to pack
+    template<METHOD method, bool mapped>
+    unsigned long run_kernel(char stage, std::size_t first_block, std::size_t last_block)
+    {
+        if (stage == 'c' && compaction_interval > 0 && lanes > 1)
+        {
+            return run_compacted<method, mapped>(first_block, last_block);
+        }
+        return run_blocks<method, mapped>(stage, first_block, last_block);
+    }
+
+    //the field lookup is chosen here, once per call, so the uniform kernels carry none of it
+    template<METHOD method>
+    unsigned long run_kernel(char stage, std::size_t first_block, std::size_t last_block)
+    {
+        if (params->fields)
+        {
+            return run_kernel<method, true>(stage, first_block, last_block);
+        }
+        return run_kernel<method, false>(stage, first_block, last_block);
+    }
+
+    /**
+     * advances the blocks [first_block, last_block) with the method in params and returns the crashes.
+     * the method is dispatched once per call, never inside the stepping loop.
+     */
+    unsigned long run_range(char stage, std::size_t first_block, std::size_t last_block)
+    {
+        switch (params->method)
+        {
+            case TAYLOR:
+                return run_kernel<TAYLOR>(stage, first_block, last_block);
+            case MIDPOINT:
+                return run_kernel<MIDPOINT>(stage, first_block, last_block);
+            case RUNGE_KUTTA:
+                return run_kernel<RUNGE_KUTTA>(stage, first_block, last_block);
+            case SSPRK3:
+                return run_kernel<SSPRK3>(stage, first_block, last_block);
+            case RK6:
+                return run_kernel<RK6>(stage, first_block, last_block);
+            case BORIS:
+                return run_kernel<BORIS>(stage, first_block, last_block);
+            case ANALYTIC:
+            case DORMAND_PRINCE:
+                return run_scalar(stage, first_block, last_block);
+        }
+        return 0;
+    }
+
+    std::size_t n_blocks() const
+    {
+        return padded_size / lanes;
+    }
+
+    void run(char stage, unsigned n_threads = 1)
+    {
+        //blocks are handed out in chunks of whole SIMD blocks
+        WorkStealingScheduler scheduler(n_threads, std::max<std::size_t>(1, DEFAULT_CHUNK_SIZE / lanes));
+        std::vector<ThreadTally> crashes(scheduler.n_threads);
+        scheduler.run(n_blocks(), [&](std::size_t begin, std::size_t end, unsigned thread_id) {
+            crashes[thread_id].value += run_range(stage, begin, end);
+        });
+
+        for (const auto &tally: crashes)
+        {
+            crash_counter += tally.value;
+        }
+    }
+};
+
+typedef BasicEnsemble<double> Ensemble;
+
+
+#endif //NUMERICAL_CPP_ENSEMBLE_HPP
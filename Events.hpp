@@ -0,0 +1,152 @@
+#ifndef NUMERICAL_CPP_EVENTS_HPP
+#define NUMERICAL_CPP_EVENTS_HPP
+
+#include "State.hpp"
+#include <cmath>
+#include <algorithm>
+#include <utility>
+
+#define EVENT_REFINE_ITERATIONS 64
+
+/**
+ * c[0] + c[1] s + c[2] s^2 + c[3] s^3 on s in [0, 1]
+ */
+class Cubic
+{
+public:
+    long double c[4];
+
+    /**
+     * cubic Hermite interpolant of a quantity with values p0, p1 and time derivatives m0, m1
+     * at the two ends of a step of length h
+     */
+    static Cubic hermite(long double p0, long double p1, long double m0, long double m1, long double h)
+    {
+        return {{p0, h * m0, 3 * (p1 - p0) - 2 * h * m0 - h * m1, 2 * (p0 - p1) + h * m0 + h * m1}};
+    }
+
+    long double operator()(long double s) const
+    {
+        return ((c[3] * s + c[2]) * s + c[1]) * s + c[0];
+    }
+
+    /**
+     * smallest s in (0, 1] with value >= 0, given a negative value at 0; 2 if there is none.
+     * the interval is cut at the extrema of the cubic so a crossing that goes back within the
+     * step (a particle grazing the wall) is still found, then the monotone piece is bisected.
+     */
+    long double first_crossing() const
+    {
+        long double bounds[4] = {0, 1, 1, 1};
+        int n_bounds = 1;
+
+        //roots of the derivative 3 c3 s^2 + 2 c2 s + c1
+        long double A = 3 * c[3], B = 2 * c[2], C = c[1];
+        if (A == 0)
+        {
+            if (B != 0 && -C / B > 0 && -C / B < 1)
+            {
+                bounds[n_bounds++] = -C / B;
+            }
+        }
+        else if (B * B - 4 * A * C >= 0)
+        {
+            auto root = std::sqrt(B * B - 4 * A * C);
+            for (long double s: {(-B - root) / (2 * A), (-B + root) / (2 * A)})
+            {
+                if (s > 0 && s < 1)
+                {
+                    bounds[n_bounds++] = s;
+                }
+            }
+            //at most two roots, compare and swap
+            if (n_bounds == 3 && bounds[2] < bounds[1])
+            {
+                std::swap(bounds[1], bounds[2]);
+            }
+        }
+        bounds[n_bounds++] = 1;
+
+        for (int i = 1; i < n_bounds; i++)
+        {
+            if ((*this)(bounds[i]) >= 0)
+            {
+                long double lo = bounds[i - 1], hi = bounds[i];
+                for (int iteration = 0; iteration < EVENT_REFINE_ITERATIONS && lo < hi; iteration++)
+                {
+                    auto mid = lo + (hi - lo) / 2;
+                    ((*this)(mid) >= 0 ? hi : lo) = mid;
+                }
+                return hi;
+            }
+        }
+        return 2;
+    }
+};
+
+/**
+ * Dense output of one step: every component of (y, z, vy, vz) is interpolated by a cubic Hermite
+ * polynomial from its values and derivatives (f = dx/dt) at both ends of the step.
+ */
+class StepInterpolant
+{
+public:
+    Cubic component[4];
+
+    StepInterpolant(const StateVector &x0, const StateVector &f0, const StateVector &x1, const StateVector &f1,
+                    long double h)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            component[i] = Cubic::hermite(x0[i], x1[i], f0[i], f1[i], h);
+        }
+    }
+
+    StateVector operator()(long double s) const
+    {
+        return {component[0](s), component[1](s), component[2](s), component[3](s)};
+    }
+};
+
+class Crossing
+{
+public:
+    bool found = false;
+    bool crashed = false;
+    long double s = 2;      //fraction of the step at which it happens
+};
+
+/**
+ * first wall (|y| = R) or exit (z = L) crossing inside a step, the earlier of the two wins
+ */
+static Crossing locate_crossing(const StepInterpolant &step, long double R, long double L)
+{
+    auto y = step.component[0];
+    auto z = step.component[1];
+
+    Cubic above = y, below = y, exit = z;
+    above.c[0] -= R;            //y - R
+    for (auto &c: below.c)      //-y - R
+    {
+        c = -c;
+    }
+    below.c[0] -= R;
+    exit.c[0] -= L;             //z - L
+
+    auto s_wall = std::min(above.first_crossing(), below.first_crossing());
+    auto s_exit = exit.first_crossing();
+
+    Crossing crossing;
+    if (s_wall <= 1 && s_wall <= s_exit)
+    {
+        crossing = {true, true, s_wall};
+    }
+    else if (s_exit <= 1)
+    {
+        crossing = {true, false, s_exit};
+    }
+    return crossing;
+}
+
+
+#endif //NUMERICAL_CPP_EVENTS_HPP
@@ -0,0 +1,281 @@
+#ifndef NUMERICAL_CPP_FIELDMAP_HPP
+#define NUMERICAL_CPP_FIELDMAP_HPP
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <filesystem>
+
+#define FIELD_TILE 4        //nodes per tile side; a tile of {E, B} doubles is 256 bytes, four cache lines
+
+enum INTERPOLATION
+{
+    BILINEAR,
+    BICUBIC
+};
+
+class FieldSample
+{
+public:
+    long double E;      //along y
+    long double B;      //along x, out of the (y, z) plane
+};
+
+/**
+ * E(y, z) and B(y, z) on a regular grid of ny x nz nodes, node (i, j) at (y0 + i dy, z0 + j dz).
+ * In memory the grid is cut into FIELD_TILE x FIELD_TILE tiles stored one after the other, and
+ * E and B of a node sit side by side, so the 2x2 (bilinear) or 4x4 (bicubic) neighbourhood of a
+ * point usually lies in one or two tiles instead of on 2 or 4 rows far apart.
+ * Outside the grid the field of the nearest edge is used.
+ *
+ * File format, little endian:
+ *   offset 0   char[8]  magic "WFFIELD1"
+ *          8   u64      ny          16  u64  nz
+ *         24   f64      y0          32  f64  z0          40  f64  dy          48  f64  dz
+ *         56   u64      reserved
+ *         64   f64[ny * nz] E, row-major (j fastest), then f64[ny * nz] B
+ * so numpy.fromfile(file, '<f8', offset=64).reshape(2, ny, nz) gives both maps.
+ */
+class FieldMap
+{
+public:
+    std::size_t ny = 0;
+    std::size_t nz = 0;
+    double y0 = 0;
+    double z0 = 0;
+    double dy = 1;
+    double dz = 1;
+    INTERPOLATION interpolation = BILINEAR;
+
+    FieldMap() = default;
+
+    FieldMap(std::size_t ny, std::size_t nz, double y0, double z0, double dy, double dz)
+            : ny(std::max<std::size_t>(2, ny)), nz(std::max<std::size_t>(2, nz)), y0(y0), z0(z0), dy(dy), dz(dz),
+              tiles_z((this->nz + FIELD_TILE - 1) / FIELD_TILE),
+              nodes(((this->ny + FIELD_TILE - 1) / FIELD_TILE) * tiles_z * FIELD_TILE * FIELD_TILE)
+    {}
+
+    /**
+     * samples f(y, z) -> FieldSample at every node of the grid
+     */
+    template<typename Function>
+    static FieldMap sample(std::size_t ny, std::size_t nz, double y0, double z0, double dy, double dz, Function &&f)
+    {
+        FieldMap map(ny, nz, y0, z0, dy, dz);
+        for (std::size_t i = 0; i < map.ny; i++)
+        {
+            for (std::size_t j = 0; j < map.nz; j++)
+            {
+                auto field = f(y0 + i * dy, z0 + j * dz);
+                map.set(i, j, (double) field.E, (double) field.B);
+            }
+        }
+        return map;
+    }
+
+    void set(std::size_t i, std::size_t j, double E, double B)
+    {
+        nodes[index(i, j)] = {E, B};
+    }
+
+    FieldSample node(std::size_t i, std::size_t j) const
+    {
+        const auto &n = nodes[index(i, j)];
+        return {n.E, n.B};
+    }
+
+    FieldSample operator()(long double y, long double z) const
+    {
+        return interpolation == BICUBIC ? bicubic((double) y, (double) z) : bilinear((double) y, (double) z);
+    }
+
+    /**
+     * FNV-1a hash of the geometry, the interpolation and every node; tells maps apart without comparing them
+     */
+    std::uint64_t fingerprint() const
+    {
+        std::uint64_t hash = 0xcbf29ce484222325ULL;
+        auto mix = [&hash](const void *data, std::size_t size) {
+            auto bytes = static_cast<const unsigned char *>(data);
+            for (std::size_t i = 0; i < size; i++)
+            {
+                hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+            }
+        };
+        std::uint64_t sizes[2] = {ny, nz};
+        double geometry[4] = {y0, z0, dy, dz};
+        std::uint32_t mode = interpolation;
+        mix(sizes, sizeof(sizes));
+        mix(geometry, sizeof(geometry));
+        mix(&mode, sizeof(mode));
+        mix(nodes.data(), nodes.size() * sizeof(Node));
+        return hash;
+    }
+
+    void save(const std::string &filename) const
+    {
+        std::ofstream output(filename, std::ios::binary);
+        std::uint64_t sizes[2] = {ny, nz};
+        double geometry[4] = {y0, z0, dy, dz};
+        std::uint64_t reserved = 0;
+        output.write("WFFIELD1", 8);
+        output.write(reinterpret_cast<const char *>(sizes), sizeof(sizes));
+        output.write(reinterpret_cast<const char *>(geometry), sizeof(geometry));
+        output.write(reinterpret_cast<const char *>(&reserved), sizeof(reserved));
+        std::vector<double> row(nz);
+        for (int component = 0; component < 2; component++)
+        {
+            for (std::size_t i = 0; i < ny; i++)
+            {
+                for (std::size_t j = 0; j < nz; j++)
+                {
+                    const auto &n = nodes[index(i, j)];
+                    row[j] = component ? n.B : n.E;
+                }
+                output.write(reinterpret_cast<const char *>(row.data()), (std::streamsize) (nz * sizeof(double)));
+            }
+        }
+    }
+
+    static FieldMap load(const std::string &filename)
+    {
+        std::ifstream input(filename, std::ios::binary);
+        char magic[8];
+        std::uint64_t sizes[2];
+        double geometry[4];
+        std::uint64_t reserved;
+        input.read(magic, 8);
+        input.read(reinterpret_cast<char *>(sizes), sizeof(sizes));
+        input.read(reinterpret_cast<char *>(geometry), sizeof(geometry));
+        input.read(reinterpret_cast<char *>(&reserved), sizeof(reserved));
+        if (!input || std::memcmp(magic, "WFFIELD1", 8) != 0 || sizes[0] < 2 || sizes[1] < 2)
+        {
+            throw std::runtime_error(filename + " is not a field map");
+        }
+        //a non-positive or non-finite spacing would make locate() divide by zero or convert NaN to an index
+        if (!std::isfinite(geometry[0]) || !std::isfinite(geometry[1]) || !std::isfinite(geometry[2]) ||
+            !std::isfinite(geometry[3]) || !(geometry[2] > 0) || !(geometry[3] > 0))
+        {
+            throw std::runtime_error(filename + " has an invalid grid geometry");
+        }
+        //checked against the file size before anything is allocated, without overflowing ny * nz
+        auto file_size = std::filesystem::file_size(filename);
+        auto max_nodes = (file_size - 64) / (2 * sizeof(double));
+        if (sizes[0] > max_nodes / sizes[1] || 64 + 2 * sizes[0] * sizes[1] * sizeof(double) != file_size)
+        {
+            throw std::runtime_error(filename + " does not hold the " + std::to_string(sizes[0]) + " x " +
+                                     std::to_string(sizes[1]) + " grid its header announces");
+        }
+        FieldMap map(sizes[0], sizes[1], geometry[0], geometry[1], geometry[2], geometry[3]);
+        std::vector<double> row(map.nz);
+        for (int component = 0; component < 2; component++)
+        {
+            for (std::size_t i = 0; i < map.ny; i++)
+            {
+                input.read(reinterpret_cast<char *>(row.data()), (std::streamsize) (map.nz * sizeof(double)));
+                for (std::size_t j = 0; j < map.nz; j++)
+                {
+                    (component ? map.nodes[map.index(i, j)].B : map.nodes[map.index(i, j)].E) = row[j];
+                }
+            }
+        }
+        if (!input)
+        {
+            throw std::runtime_error(filename + " is truncated");
+        }
+        return map;
+    }
+
+    struct Node
+    {
+        double E;
+        double B;
+    };
+
+    //node (i, j) as stored, for kernels that interpolate on their own (see BasicEnsemble::fields_at)
+    const Node &at(std::size_t i, std::size_t j) const
+    {
+        return nodes[index(i, j)];
+    }
+
+    //Catmull-Rom weights of the nodes k - 1 .. k + 2 at offset t from node k; T is a scalar or SIMD lanes of Real
+    template<typename T, typename Real = T>
+    static void cubic_weights(const T &t, T w[4])
+    {
+        T t2 = t * t, t3 = t2 * t;
+        w[0] = Real(0.5) * (-t3 + Real(2) * t2 - t);
+        w[1] = Real(0.5) * (Real(3) * t3 - Real(5) * t2 + Real(2));
+        w[2] = Real(0.5) * (-Real(3) * t3 + Real(4) * t2 + t);
+        w[3] = Real(0.5) * (t3 - t2);
+    }
+
+private:
+    std::size_t tiles_z = 0;
+    std::vector<Node> nodes;
+
+    std::size_t index(std::size_t i, std::size_t j) const
+    {
+        auto tile = (i / FIELD_TILE) * tiles_z + j / FIELD_TILE;
+        return tile * FIELD_TILE * FIELD_TILE + (i % FIELD_TILE) * FIELD_TILE + j % FIELD_TILE;
+    }
+
+    /**
+     * cell of a coordinate: node index k in [0, n - 2] and the offset t in [0, 1] from it, clamped to the grid
+     */
+    static void locate(double x, double origin, double spacing, std::size_t n, std::size_t &k, double &t)
+    {
+        double f = std::clamp((x - origin) / spacing, 0.0, (double) (n - 1));
+        k = std::min((std::size_t) f, n - 2);
+        t = f - k;
+    }
+
+    FieldSample bilinear(double y, double z) const
+    {
+        std::size_t i, j;
+        double ty, tz;
+        locate(y, y0, dy, ny, i, ty);
+        locate(z, z0, dz, nz, j, tz);
+        const auto &a = nodes[index(i, j)], &b = nodes[index(i, j + 1)];
+        const auto &c = nodes[index(i + 1, j)], &d = nodes[index(i + 1, j + 1)];
+        double w00 = (1 - ty) * (1 - tz), w01 = (1 - ty) * tz, w10 = ty * (1 - tz), w11 = ty * tz;
+        return {w00 * a.E + w01 * b.E + w10 * c.E + w11 * d.E, w00 * a.B + w01 * b.B + w10 * c.B + w11 * d.B};
+    }
+
+    /**
+     * Catmull-Rom interpolation on the 4x4 nodes around the point, edge nodes repeated at the border.
+     * exact for fields that are quadratic in y and z, and C1 across cells.
+     */
+    FieldSample bicubic(double y, double z) const
+    {
+        std::size_t i, j;
+        double ty, tz, wy[4], wz[4];
+        locate(y, y0, dy, ny, i, ty);
+        locate(z, z0, dz, nz, j, tz);
+        cubic_weights(ty, wy);
+        cubic_weights(tz, wz);
+        double E = 0, B = 0;
+        for (int a = 0; a < 4; a++)
+        {
+            auto ia = (std::size_t) std::clamp<long>((long) i + a - 1, 0, (long) ny - 1);
+            double rowE = 0, rowB = 0;
+            for (int b = 0; b < 4; b++)
+            {
+                auto jb = (std::size_t) std::clamp<long>((long) j + b - 1, 0, (long) nz - 1);
+                const auto &n = nodes[index(ia, jb)];
+                rowE += wz[b] * n.E;
+                rowB += wz[b] * n.B;
+            }
+            E += wy[a] * rowE;
+            B += wy[a] * rowB;
+        }
+        return {E, B};
+    }
+};
+
+
+#endif //NUMERICAL_CPP_FIELDMAP_HPP
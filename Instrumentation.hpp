@@ -0,0 +1,266 @@
+#ifndef NUMERICAL_CPP_INSTRUMENTATION_HPP
+#define NUMERICAL_CPP_INSTRUMENTATION_HPP
+
+/**
+ * Counters and phase timers for the hot paths of Simulation and Particle.
+ * Everything goes through the INSTRUMENT_* macros, which expand to nothing unless
+ * NUMERICAL_CPP_INSTRUMENT is defined (cmake -DNUMERICAL_CPP_INSTRUMENT=ON), so a normal build
+ * carries no trace of it.
+ * Each thread writes to its own cache-line aligned probe; probes are only summed when a report is
+ * made. Phases may nest: STEPPING contains BOUNDARY_CHECK and HISTORY_INSERT, which are timed
+ * per step and therefore only on the wall clock (a thread CPU clock read costs about as much as
+ * a step). With instrumentation on, those two timers add noticeably to the step cost.
+ */
+
+enum COUNTER
+{
+    STEPS,
+    CRASHES,
+    PASSES,
+    HISTORY_ENTRIES,    //samples stored, initial and latest state not included
+    N_COUNTERS
+};
+
+enum PHASE
+{
+    SETUP,
+    STEPPING,
+    BOUNDARY_CHECK,
+    HISTORY_INSERT,
+    EXPORT,
+    N_PHASES
+};
+
+#ifdef NUMERICAL_CPP_INSTRUMENT
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <bit>
+#include <ctime>
+
+#define STEP_HISTOGRAM_BUCKETS 65      //bucket b holds particles with 2^(b-1) <= steps < 2^b
+
+struct alignas(64) ThreadProbe
+{
+    std::array<unsigned long, N_COUNTERS> counters{};
+    std::array<unsigned long, N_PHASES> calls{};
+    std::array<long long, N_PHASES> wall_ns{};
+    std::array<long long, N_PHASES> cpu_ns{};
+    std::array<unsigned long, STEP_HISTOGRAM_BUCKETS> steps_per_particle{};
+
+    void merge(const ThreadProbe &other)
+    {
+        for (int i = 0; i < N_COUNTERS; i++)
+        {
+            counters[i] += other.counters[i];
+        }
+        for (int i = 0; i < N_PHASES; i++)
+        {
+            calls[i] += other.calls[i];
+            wall_ns[i] += other.wall_ns[i];
+            cpu_ns[i] += other.cpu_ns[i];
+        }
+        for (int i = 0; i < STEP_HISTOGRAM_BUCKETS; i++)
+        {
+            steps_per_particle[i] += other.steps_per_particle[i];
+        }
+    }
+};
+
+class Instrumentation
+{
+public:
+    /**
+     * probe of the calling thread, registered on first use and kept after the thread exits
+     */
+    static ThreadProbe &local()
+    {
+        thread_local ThreadProbe *probe = nullptr;
+        if (!probe)
+        {
+            auto &self = instance();
+            std::lock_guard<std::mutex> lock(self.mutex);
+            self.probes.push_back(std::make_unique<ThreadProbe>());
+            probe = self.probes.back().get();
+        }
+        return *probe;
+    }
+
+    static void finished(unsigned long steps, bool crashed, bool passed)
+    {
+        auto &probe = local();
+        probe.counters[STEPS] += steps;
+        probe.counters[CRASHES] += crashed;
+        probe.counters[PASSES] += passed;
+        probe.steps_per_particle[std::bit_width(steps)]++;
+    }
+
+    static ThreadProbe total()
+    {
+        auto &self = instance();
+        std::lock_guard<std::mutex> lock(self.mutex);
+        ThreadProbe sum;
+        for (const auto &probe: self.probes)
+        {
+            sum.merge(*probe);
+        }
+        return sum;
+    }
+
+    /**
+     * zeroes every probe; call only while no instrumented code runs
+     */
+    static void reset()
+    {
+        auto &self = instance();
+        std::lock_guard<std::mutex> lock(self.mutex);
+        for (auto &probe: self.probes)
+        {
+            *probe = ThreadProbe{};
+        }
+    }
+
+    static std::string json()
+    {
+        static const char *counter_names[N_COUNTERS] = {"steps", "crashes", "passes", "history_entries"};
+        static const char *phase_names[N_PHASES] = {"setup", "stepping", "boundary_check", "history_insert",
+                                                    "export"};
+        auto sum = total();
+        std::ostringstream out;
+        out << "{\n  \"threads\": " << instance().probes.size() << ",\n  \"counters\": {";
+        for (int i = 0; i < N_COUNTERS; i++)
+        {
+            out << (i ? ", " : "") << "\"" << counter_names[i] << "\": " << sum.counters[i];
+        }
+        out << "},\n  \"phases\": {\n";
+        for (int i = 0; i < N_PHASES; i++)
+        {
+            out << "    \"" << phase_names[i] << "\": {\"calls\": " << sum.calls[i] << ", \"wall_s\": "
+                << sum.wall_ns[i] * 1e-9 << ", \"cpu_s\": " << sum.cpu_ns[i] * 1e-9 << "}"
+                << (i + 1 < N_PHASES ? "," : "") << "\n";
+        }
+        //bucket b as [2^(b-1), 2^b), empty buckets left out
+        out << "  },\n  \"steps_per_particle\": [";
+        bool first = true;
+        for (int b = 0; b < STEP_HISTOGRAM_BUCKETS; b++)
+        {
+            if (sum.steps_per_particle[b])
+            {
+                unsigned long from = b ? 1ul << (b - 1) : 0;
+                out << (first ? "" : ", ") << "{\"from\": " << from << ", \"count\": " << sum.steps_per_particle[b]
+                    << "}";
+                first = false;
+            }
+        }
+        out << "]\n}\n";
+        return out.str();
+    }
+
+    static void dump(const std::string &filename)
+    {
+        std::ofstream(filename) << json();
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadProbe>> probes;
+
+    static Instrumentation &instance()
+    {
+        static Instrumentation self;
+        return self;
+    }
+};
+
+/**
+ * adds the wall time (and, for coarse phases, the thread CPU time) of its scope to a phase
+ */
+template<bool with_cpu>
+class PhaseTimer
+{
+public:
+    explicit PhaseTimer(PHASE phase) : phase(phase), wall(std::chrono::steady_clock::now()), cpu(thread_cpu_ns())
+    {}
+
+    ~PhaseTimer()
+    {
+        auto &probe = Instrumentation::local();
+        probe.calls[phase]++;
+        probe.wall_ns[phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - wall).count();
+        if constexpr (with_cpu)
+        {
+            probe.cpu_ns[phase] += thread_cpu_ns() - cpu;
+        }
+    }
+
+private:
+    PHASE phase;
+    std::chrono::steady_clock::time_point wall;
+    long long cpu;
+
+    static long long thread_cpu_ns()
+    {
+        if constexpr (!with_cpu)
+        {
+            return 0;
+        }
+        timespec now{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+        return now.tv_sec * 1000000000LL + now.tv_nsec;
+    }
+};
+
+/**
+ * counts the steps and the outcome of one particle run when it goes out of scope
+ */
+class ParticleProbe
+{
+public:
+    ParticleProbe(const unsigned long &steps, const bool &crashed, const bool &passed) : steps(steps), before(steps),
+                                                                                         crashed(crashed),
+                                                                                         passed(passed)
+    {}
+
+    ~ParticleProbe()
+    {
+        Instrumentation::finished(steps - before, crashed, passed);
+    }
+
+private:
+    const unsigned long &steps;
+    unsigned long before;
+    const bool &crashed;
+    const bool &passed;
+};
+
+#define INSTRUMENT_CONCAT_(a, b) a##b
+#define INSTRUMENT_CONCAT(a, b) INSTRUMENT_CONCAT_(a, b)
+#define INSTRUMENT_COUNT(counter, n) (Instrumentation::local().counters[counter] += (n))
+#define INSTRUMENT_PHASE(phase) PhaseTimer<true> INSTRUMENT_CONCAT(phase_timer_, __LINE__)(phase)
+#define INSTRUMENT_HOT_PHASE(phase) PhaseTimer<false> INSTRUMENT_CONCAT(phase_timer_, __LINE__)(phase)
+#define INSTRUMENT_PARTICLE(steps, crashed, passed) ParticleProbe INSTRUMENT_CONCAT(particle_probe_, __LINE__)(steps, crashed, passed)
+#define INSTRUMENT_FINISHED(steps, crashed, passed) Instrumentation::finished(steps, crashed, passed)
+#define INSTRUMENT_RESET() Instrumentation::reset()
+#define INSTRUMENT_DUMP(filename) Instrumentation::dump(filename)
+
+#else
+
+#define INSTRUMENT_COUNT(counter, n) ((void) 0)
+#define INSTRUMENT_PHASE(phase) ((void) 0)
+#define INSTRUMENT_HOT_PHASE(phase) ((void) 0)
+#define INSTRUMENT_PARTICLE(steps, crashed, passed) ((void) 0)
+#define INSTRUMENT_FINISHED(steps, crashed, passed) ((void) 0)
+#define INSTRUMENT_RESET() ((void) 0)
+#define INSTRUMENT_DUMP(filename) ((void) 0)
+
+#endif
+
+
+#endif //NUMERICAL_CPP_INSTRUMENTATION_HPP
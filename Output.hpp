@@ -0,0 +1,312 @@
+#ifndef NUMERICAL_CPP_OUTPUT_HPP
+#define NUMERICAL_CPP_OUTPUT_HPP
+
+#include "ProblemParameters.hpp"
+#include "Instrumentation.hpp"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#define COLUMN_ALIGNMENT 64
+#define COLUMN_NAME_SIZE 16
+#define CSV_BUFFER_SIZE (1 << 20)
+
+/**
+ * A set of equally long named double columns: one trajectory (rows = samples)
+ * or one ensemble (rows = particles).
+ * Values are narrowed to double when they are added, so every export format (binary, .npy, CSV)
+ * holds at most double precision, also for LONG_DOUBLE and DOUBLE_DOUBLE runs.
+ */
+class ColumnTable
+{
+public:
+    std::vector<std::string> names;
+    std::vector<std::vector<double>> columns;
+
+    explicit ColumnTable(std::vector<std::string> names) : names(std::move(names)), columns(this->names.size())
+    {}
+
+    std::size_t rows() const
+    {
+        return columns.empty() ? 0 : columns[0].size();
+    }
+
+    void reserve(std::size_t n)
+    {
+        for (auto &column: columns)
+        {
+            column.reserve(n);
+        }
+    }
+
+    void add_row(std::initializer_list<double> row)
+    {
+        std::size_t i = 0;
+        for (auto value: row)
+        {
+            columns[i++].push_back(value);
+        }
+    }
+};
+
+/**
+ * what produced a table, stored in the header of the binary format
+ */
+class RunInfo
+{
+public:
+    ProblemParameters params;
+    std::uint64_t seed = 0;
+    std::uint32_t run_id = 0;
+};
+
+/**
+ * Binary columnar file, little endian:
+ *   offset 0    char[8]   magic "WFCOLS1\0"
+ *          8    u32       header size in bytes (multiple of 64, columns start here)
+ *         12    u32       number of columns
+ *         16    u64       number of rows
+ *         24    u64       bytes per column including padding (multiple of 64)
+ *         32    u32       method          36  u32  precision
+ *         40    u64       seed            48  u32  run id         52  u32  reserved
+ *         56    f64[9]    E, B, m, q, w, T, dt, R, L
+ *        128    char[16]  name of every column, zero padded
+ * followed by the columns, column c at header size + c * bytes per column.
+ * Every column is 64-byte aligned, so it can be memory-mapped as a plain double array
+ * (e.g. numpy.memmap(file, '<f8', offset=header + c * stride, shape=rows)).
+ * The columns are always f64: the precision field records the arithmetic of the run, not the
+ * width of the stored values, which lose whatever a LONG_DOUBLE or DOUBLE_DOUBLE run had beyond double.
+ */
+class ColumnFileHeader
+{
+public:
+    char magic[8] = {'W', 'F', 'C', 'O', 'L', 'S', '1', '\0'};
+    std::uint32_t header_size;
+    std::uint32_t n_columns;
+    std::uint64_t n_rows;
+    std::uint64_t column_stride;
+    std::uint32_t method;
+    std::uint32_t precision;
+    std::uint64_t seed;
+    std::uint32_t run_id;
+    std::uint32_t reserved = 0;
+    double fields[9];
+};
+
+static_assert(sizeof(ColumnFileHeader) == 128, "the binary header layout is part of the file format");
+
+static std::size_t round_up(std::size_t n, std::size_t multiple)
+{
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+static void write_binary(const std::string &filename, const ColumnTable &table, const RunInfo &info)
+{
+    INSTRUMENT_PHASE(EXPORT);
+    ColumnFileHeader header;
+    header.n_columns = (std::uint32_t) table.names.size();
+    header.header_size = (std::uint32_t) round_up(sizeof(header) + header.n_columns * COLUMN_NAME_SIZE,
+                                                  COLUMN_ALIGNMENT);
+    header.n_rows = table.rows();
+    header.column_stride = round_up(header.n_rows * sizeof(double), COLUMN_ALIGNMENT);
+    header.method = info.params.method;
+    header.precision = info.params.precision;
+    header.seed = info.seed;
+    header.run_id = info.run_id;
+    const auto &p = info.params;
+    double fields[9] = {(double) p.E, (double) p.B, (double) p.m, (double) p.q, (double) p.w, (double) p.T,
+                        (double) p.dt, (double) p.R, (double) p.L};
+    std::memcpy(header.fields, fields, sizeof(fields));
+
+    std::vector<char> head(header.header_size, 0);
+    std::memcpy(head.data(), &header, sizeof(header));
+    for (std::size_t c = 0; c < table.names.size(); c++)
+    {
+        std::strncpy(head.data() + sizeof(header) + c * COLUMN_NAME_SIZE, table.names[c].c_str(),
+                     COLUMN_NAME_SIZE - 1);
+    }
+
+    std::ofstream output(filename, std::ios::binary);
+    output.write(head.data(), (std::streamsize) head.size());
+    std::vector<char> padding(header.column_stride - header.n_rows * sizeof(double), 0);
+    for (const auto &column: table.columns)
+    {
+        output.write(reinterpret_cast<const char *>(column.data()), (std::streamsize) (column.size() * sizeof(double)));
+        output.write(padding.data(), (std::streamsize) padding.size());
+    }
+}
+
+//inline rather than static: most translation units write column files but never read one
+inline ColumnTable read_binary(const std::string &filename, RunInfo *info = nullptr)
+{
+    std::ifstream input(filename, std::ios::binary);
+    ColumnFileHeader header;
+    input.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!input || std::memcmp(header.magic, "WFCOLS1", 8) != 0)
+    {
+        throw std::runtime_error(filename + " is not a column file");
+    }
+
+    std::vector<std::string> names;
+    for (std::uint32_t c = 0; c < header.n_columns; c++)
+    {
+        char name[COLUMN_NAME_SIZE] = {};
+        input.read(name, COLUMN_NAME_SIZE);
+        names.emplace_back(name, strnlen(name, COLUMN_NAME_SIZE));
+    }
+
+    ColumnTable table(names);
+    for (std::uint32_t c = 0; c < header.n_columns; c++)
+    {
+        table.columns[c].resize(header.n_rows);
+        input.seekg((std::streamoff) (header.header_size + c * header.column_stride));
+        input.read(reinterpret_cast<char *>(table.columns[c].data()),
+                   (std::streamsize) (header.n_rows * sizeof(double)));
+    }
+
+    if (info)
+    {
+        auto &p = info->params;
+        p.E = header.fields[0];
+        p.B = header.fields[1];
+        p.m = header.fields[2];
+        p.q = header.fields[3];
+        p.w = header.fields[4];
+        p.T = header.fields[5];
+        p.dt = header.fields[6];
+        p.R = header.fields[7];
+        p.L = header.fields[8];
+        p.method = (METHOD) header.method;
+        p.precision = (PRECISION) header.precision;
+        info->seed = header.seed;
+        info->run_id = header.run_id;
+    }
+    return table;
+}
+
+/**
+ * NumPy .npy (format 1.0) of shape (rows, columns). The data is written column by column
+ * with fortran_order, so numpy.load gives the usual 2D array without any transposition here.
+ */
+static void write_npy(const std::string &filename, const ColumnTable &table)
+{
+    INSTRUMENT_PHASE(EXPORT);
+    std::string dict = "{'descr': '<f8', 'fortran_order': True, 'shape': (" + std::to_string(table.rows()) + ", " +
+                       std::to_string(table.columns.size()) + "), }";
+    //magic + version + length field + dict + padding + '\n' must be a multiple of 64
+    std::size_t total = round_up(10 + dict.size() + 1, 64);
+    dict.append(total - 10 - dict.size() - 1, ' ');
+    dict.push_back('\n');
+
+    std::ofstream output(filename, std::ios::binary);
+    const char magic[8] = {'\x93', 'N', 'U', 'M', 'P', 'Y', 1, 0};
+    output.write(magic, 8);
+    std::uint16_t length = (std::uint16_t) dict.size();
+    output.write(reinterpret_cast<const char *>(&length), 2);
+    output.write(dict.data(), (std::streamsize) dict.size());
+    for (const auto &column: table.columns)
+    {
+        output.write(reinterpret_cast<const char *>(column.data()), (std::streamsize) (column.size() * sizeof(double)));
+    }
+}
+
+/**
+ * CSV text through std::to_chars (shortest round-trip representation) into a large buffer,
+ * instead of formatting every number through an ostream
+ */
+class CsvWriter
+{
+public:
+    explicit CsvWriter(const std::string &filename) : output(filename, std::ios::binary)
+    {
+        buffer.reserve(CSV_BUFFER_SIZE);
+    }
+
+    ~CsvWriter()
+    {
+        flush();
+    }
+
+    template<typename T>
+    void field(T value, bool last = false)
+    {
+        char text[64];
+        auto result = std::to_chars(text, text + sizeof(text), value);
+        buffer.append(text, result.ptr);
+        buffer.push_back(last ? '\n' : ',');
+        if (buffer.size() >= CSV_BUFFER_SIZE - 128)
+        {
+            flush();
+        }
+    }
+
+    void field(const std::string &value, bool last = false)
+    {
+        buffer.append(value);
+        buffer.push_back(last ? '\n' : ',');
+    }
+
+    void line(const std::vector<std::string> &fields)
+    {
+        for (std::size_t i = 0; i < fields.size(); i++)
+        {
+            buffer.append(fields[i]);
+            buffer.push_back(i + 1 == fields.size() ? '\n' : ',');
+        }
+    }
+
+    void flush()
+    {
+        output.write(buffer.data(), (std::streamsize) buffer.size());
+        buffer.clear();
+    }
+
+private:
+    std::ofstream output;
+    std::string buffer;
+};
+
+static void write_csv(const std::string &filename, const ColumnTable &table)
+{
+    INSTRUMENT_PHASE(EXPORT);
+    CsvWriter csv(filename);
+    csv.line(table.names);
+    for (std::size_t row = 0; row < table.rows(); row++)
+    {
+        for (std::size_t c = 0; c < table.columns.size(); c++)
+        {
+            csv.field(table.columns[c][row], c + 1 == table.columns.size());
+        }
+    }
+}
+
+/**
+ * picks the format from the extension: .npy, .csv, anything else is the binary column format
+ */
+static void write_table(const std::string &filename, const ColumnTable &table, const RunInfo &info)
+{
+    auto ends_with = [&](const std::string &suffix) {
+        return filename.size() >= suffix.size() && filename.compare(filename.size() - suffix.size(), suffix.size(),
+                                                                     suffix) == 0;
+    };
+    if (ends_with(".npy"))
+    {
+        write_npy(filename, table);
+    }
+    else if (ends_with(".csv"))
+    {
+        write_csv(filename, table);
+    }
+    else
+    {
+        write_binary(filename, table, info);
+    }
+}
+
+
+#endif //NUMERICAL_CPP_OUTPUT_HPP
@@ -2,6 +2,14 @@
 #define NUMERICAL_CPP_PARTICLE_HPP
 
 #include "ProblemParameters.hpp"
+#include "State.hpp"
+#include "Analytic.hpp"
+#include "Events.hpp"
+#include "RungeKutta.hpp"
+#include "Output.hpp"
+#include "Instrumentation.hpp"
+#include "Checkpoint.hpp"
+#include "FieldMap.hpp"
 #include <unordered_map>
 #include <map>
 #include <iostream>
@@ -9,248 +17,688 @@
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <vector>
+#include <memory_resource>
+#include <limits>
+#include <stdexcept>
 
-typedef long double Time;
-
-enum CTYPE
+class Sample
 {
-    r,
-    v
+public:
+    Time t;
+    State state;
 };
 
-class DoublePair
+/**
+ * Trajectory storage of one particle, governed by the RECORD policy in ProblemParameters.
+ * The initial and the latest state are always kept; what is stored in between depends on the mode.
+ * Samples live in one contiguous buffer, FINAL_ONLY never allocates.
+ */
+class History
 {
 public:
-    std::pair<long double, long double> pair;
-
-    DoublePair() : DoublePair(0, 0)
-    {}
-
-    DoublePair(long double a, long double b) : pair(std::make_pair(a, b))
+    RECORD mode;
+    std::size_t capacity;
+    std::size_t stride;
+    Sample initial;
+    Sample last;
+    std::pmr::vector<Sample> samples;
+    std::size_t head = 0;       //oldest sample of a full ring buffer
+    unsigned long steps = 0;
+
+    History(State initial_condition, const ProblemParameters &params,
+            std::pmr::memory_resource *memory = std::pmr::get_default_resource()) : mode(params.record),
+                                                                                   capacity(std::max<std::size_t>(1, params.record_capacity)),
+                                                                                   stride(std::max<std::size_t>(1, params.record_stride)),
+                                                                                   initial{0, initial_condition},
+                                                                                   last{0, initial_condition},
+                                                                                   samples(memory)
     {}
 
-    long double &y()
+    void record(Time t, const State &state)
     {
-        return pair.first;
+        last = {t, state};
+        steps++;
+        switch (mode)
+        {
+            case FINAL_ONLY:
+                break;
+            case LAST_N:
+                if (samples.size() < capacity)
+                {
+                    samples.push_back(last);
+                }
+                else
+                {
+                    samples[head] = last;
+                    head = (head + 1) % capacity;
+                }
+                INSTRUMENT_COUNT(HISTORY_ENTRIES, 1);
+                break;
+            case EVERY_K:
+                if (steps % stride == 0)
+                {
+                    samples.push_back(last);
+                    INSTRUMENT_COUNT(HISTORY_ENTRIES, 1);
+                }
+                break;
+            case FULL:
+                samples.push_back(last);
+                INSTRUMENT_COUNT(HISTORY_ENTRIES, 1);
+                break;
+        }
     }
 
-    long double &z()
+    /**
+     * replaces the latest state, e.g. by an interpolated one when a step overshot an event
+     */
+    void revise(Time t, const State &state)
     {
-        return pair.second;
+        last = {t, state};
+        bool stored = mode == LAST_N || mode == FULL || (mode == EVERY_K && steps % stride == 0);
+        if (stored && !samples.empty())
+        {
+            samples[(head + samples.size() - 1) % samples.size()] = last;
+        }
     }
 
-    friend DoublePair &operator+(DoublePair &lhs, const DoublePair &rhs)
+    /**
+     * frees the stored samples once they have been exported, the initial and latest state stay
+     */
+    void release()
     {
-        lhs.pair.first += rhs.pair.first;
-        lhs.pair.second += rhs.pair.second;
-        return lhs;
+        std::pmr::vector<Sample>(samples.get_allocator()).swap(samples);
+        head = 0;
     }
 
-    friend DoublePair &operator*(DoublePair &lhs, const DoublePair &rhs)
+    const Sample &front() const
     {
-        lhs.pair.first *= rhs.pair.first;
-        lhs.pair.second *= rhs.pair.second;
-        return lhs;
+        return initial;
     }
 
-    friend DoublePair &operator*(DoublePair &lhs, const double &n)
+    const Sample &back() const
     {
-        lhs.pair.first *= n;
-        lhs.pair.second *= n;
-        return lhs;
+        return last;
     }
 
-    friend DoublePair &operator*(const double &n, DoublePair &rhs)
+    /**
+     * calls f(sample) for every kept sample in time order, starting with the initial state and
+     * ending with the latest one
+     */
+    template<typename Function>
+    void for_each(Function &&f) const
     {
-        rhs.pair.first *= n;
-        rhs.pair.second *= n;
-        return rhs;
+        f(initial);
+        for (std::size_t i = 0; i < samples.size(); i++)
+        {
+            f(samples[(head + i) % samples.size()]);
+        }
+        if (steps > 0 && (samples.empty() || samples[(head + samples.size() - 1) % samples.size()].t != last.t))
+        {
+            f(last);
+        }
     }
-};
 
-class State
-{
-public:
-    DoublePair r;
-    DoublePair v;
+    void save(ByteWriter &out) const
+    {
+        for (const auto *sample: {&initial, &last})
+        {
+            out.put(sample->t);
+            out.put(sample->state);
+        }
+        out.put<std::uint64_t>(steps);
+        out.put<std::uint64_t>(head);
+        out.put<std::uint64_t>(samples.size());
+        for (const auto &sample: samples)
+        {
+            out.put(sample.t);
+            out.put(sample.state);
+        }
+    }
 
-    friend std::ostream &operator<<(std::ostream &os, State &s)
+    void restore(ByteReader &in)
     {
-        std::cout << "(y,z) = (" << s.r.y() << "," << s.r.z() << ")\n";
-        std::cout << "(Vy,Vz) = (" << s.v.y() << "," << s.v.z() << ")\n";
+        for (auto *sample: {&initial, &last})
+        {
+            sample->t = in.get<Time>();
+            sample->state = in.get_state();
+        }
+        steps = in.get<std::uint64_t>();
+        head = in.get<std::uint64_t>();
+        samples.resize(in.get<std::uint64_t>());
+        for (auto &sample: samples)
+        {
+            sample.t = in.get<Time>();
+            sample.state = in.get_state();
+        }
     }
 };
 
 class Particle
 {
 public:
-    std::map<Time, State> history;
+    State state;        //current state, the integrators never read it back from the history
+    Time time = 0;
+    History history;
     ProblemParameters *params;
     bool crashed = false;
     bool passed = false;
+    bool done = false;              //the last run() completed its stage
+    Time h = 0;                     //step size of adaptive methods, 0 until the first step
+    unsigned long accepted = 0;     //accepted / rejected adaptive steps
+    unsigned long rejected = 0;
+    //first same as last: derivative at the end of the last accepted Dormand-Prince step, and that end
+    StateVector last_derivative{};
+    StateVector last_derivative_at{};
+    bool has_last_derivative = false;
+
+    /**
+     * the stored samples are allocated from `memory`, e.g. the arena of a Simulation
+     */
+    Particle(State initial_condition, ProblemParameters *params,
+             std::pmr::memory_resource *memory = std::pmr::get_default_resource()) : state(initial_condition),
+                                                                                    history(initial_condition, *params,
+                                                                                            memory),
+                                                                                    params(params)
+    {}
 
-    Particle(State initial_condition, ProblemParameters *params) : params(params)
-    {
-        history[0] = initial_condition;
-    }
-
-    DoublePair acceleration(DoublePair &v) const
+    void update(Time t, const State &new_state)
     {
-        auto factor = params->q / params->m;
-        auto ay = factor * (params->E - (params->B * v.z()));
-        auto az = factor * params->B * v.y();
-        return {ay, az};
+        INSTRUMENT_HOT_PHASE(HISTORY_INSERT);
+        state = new_state;
+        time = t;
+        history.record(t, new_state);
     }
 
-    DoublePair K1(const CTYPE &type, State last_state)
+    /**
+     * E and B at (y, z): interpolated from the field map if there is one, the uniform fields otherwise
+     */
+    FieldSample field(long double y, long double z) const
     {
-        switch (type)
+        if (params->fields)
         {
-            case r:
-                return params->dt * last_state.v;
-            case v:
-                auto a = acceleration(last_state.v);
-                return params->dt * a;
+            return (*params->fields)(y, z);
         }
+        return {params->E, params->B};
     }
 
-    DoublePair K2(const CTYPE &type, DoublePair k1, State last_state)
+    Vector2 acceleration(const State &s) const
     {
-        switch (type)
-        {
-            case r:
-                return params->dt * (last_state.v + (k1 * 0.5));
-            case v:
-                auto a = k1 * 0.5;
-                auto b = last_state.v + a;
-                auto acc = acceleration(b);
-                return acc * params->dt;
-        }
+        auto factor = params->q / params->m;
+        auto [E, B] = field(s.r.y(), s.r.z());
+        auto ay = factor * (E - (B * s.v.z()));
+        auto az = factor * B * s.v.y();
+        return {ay, az};
     }
 
-    DoublePair K3(const CTYPE &type, DoublePair k2, State last_state)
+    StateVector derivative(const StateVector &x) const
     {
-        return K2(type, k2, last_state);
+        auto factor = params->q / params->m;
+        auto [E, B] = field(x[0], x[1]);
+        return {x[2], x[3], factor * (E - B * x[3]), factor * B * x[2]};
     }
 
-    DoublePair K4(const CTYPE &type, DoublePair k3, State last_state)
+    /**
+     * one fixed step of an explicit Runge-Kutta scheme over the whole (r, v) state
+     */
+    template<const auto &tableau>
+    void advance_tableau(Time &t)
     {
-        switch (type)
-        {
-            case r:
-                return params->dt * (last_state.v + k3);
-            case v:
-                auto acc = acceleration(k3 + last_state.v);
-                return params->dt * acc;
-        }
+        auto x = rk_step<tableau>(to_vector(state), params->dt, [this](const StateVector &x) {
+            return derivative(x);
+        });
+
+        //insert new data
+        update(t, to_state(x));
     }
 
-    void advance_taylor(Time &t)
+    /**
+     * Boris push: half electric kick, exact-norm magnetic rotation, half electric kick, drift.
+     * one field evaluation per step; the rotation by 2*atan(w*dt/2) keeps |v| in the magnetic part
+     * exactly, so the energy error stays bounded and the gyration stays stable at large w*dt.
+     * velocities are treated as staggered half a step behind the positions (leapfrog).
+     */
+    void advance_boris(Time &t)
     {
         //take last state
-        auto last_state = (--history.end())->second;
+        auto last_state = state;
+
+        //fields at the position the velocity update is centred on
+        auto [E, B] = field(last_state.r.y(), last_state.r.z());
+        auto factor = params->q / params->m;
+        auto kick = factor * E * params->dt / 2;
+        auto tangent = factor * B * params->dt / 2;
+        auto sine = 2 * tangent / (1 + tangent * tangent);
+
+        //half electric kick
+        auto vy = last_state.v.y() + kick;
+        auto vz = last_state.v.z();
 
-        //calc velocity
-        auto a = acceleration(last_state.v);
-        auto v = last_state.v + a * params->dt;
+        //magnetic rotation
+        auto vy_prime = vy - tangent * vz;
+        auto vz_prime = vz + tangent * vy;
+        vy -= sine * vz_prime;
+        vz += sine * vy_prime;
 
-        //calc position
-        auto r = last_state.r + last_state.v * params->dt;
+        //half electric kick
+        vy += kick;
+
+        //drift
+        auto y = last_state.r.y() + vy * params->dt;
+        auto z = last_state.r.z() + vz * params->dt;
 
         //insert new data
-        history[t] = {r, v};
+        update(t, {{y,  z},
+                   {vy, vz}});
     }
 
-    void advance_midpoint(Time &t)
+    void advance_analytic(Time &t)
     {
-        //take last state
-        auto last_state = (--history.end())->second;
+        //exact state at t, always evaluated from the initial condition so no error accumulates
+        update(t, CrossedFieldSolution(history.front().state, *params).at(t));
+    }
 
-        //calculate velocity
-        auto k1 = K1(v, last_state);
-        auto k2 = K2(v, k1, last_state);
-        auto v = last_state.v + k2;
+    /**
+     * decides crash or pass without time stepping: the particle crashes if it reaches |y| = R
+     * no later than z = L. the final state is the one at the crossing.
+     */
+    void classify_analytic()
+    {
+        CrossedFieldSolution solution(history.front().state, *params);
+        auto t_wall = solution.wall_time();
+        auto t_exit = solution.exit_time();
+        if (t_wall == NEVER && t_exit == NEVER)
+        {
+            return;
+        }
 
-        //calculate position
-        k1 = K1(r, last_state);
-        k2 = K2(r, k1, last_state);
-        auto r = last_state.r + k2;
+        crashed = t_wall <= t_exit;
+        passed = !crashed;
+        auto t = crashed ? t_wall : t_exit;
+        update(t, solution.at(t));
+    }
 
-        //insert new data
-        history[t] = {r, v};
+    /**
+     * one accepted Dormand-Prince 5(4) step that does not go past t_end.
+     * the step size is kept per particle and adapted from the embedded 4th order error estimate,
+     * scaled by atol + rtol * |x| per component.
+     */
+    void advance_dormand_prince(Time t_end)
+    {
+        static constexpr long double a[7][6] = {
+                {},
+                {1.0L / 5},
+                {3.0L / 40,       9.0L / 40},
+                {44.0L / 45,      -56.0L / 15,      32.0L / 9},
+                {19372.0L / 6561, -25360.0L / 2187, 64448.0L / 6561, -212.0L / 729},
+                {9017.0L / 3168,  -355.0L / 33,     46732.0L / 5247, 49.0L / 176,   -5103.0L / 18656},
+                {35.0L / 384,     0,                500.0L / 1113,   125.0L / 192,  -2187.0L / 6784, 11.0L / 84}};
+        //5th order solution minus embedded 4th order solution
+        static constexpr long double e[7] = {71.0L / 57600, 0, -71.0L / 16695, 71.0L / 1920, -17253.0L / 339200,
+                                             22.0L / 525, -1.0L / 40};
+
+        if (h <= 0)
+        {
+            h = params->dt;
+        }
+
+        auto x = to_vector(state);
+        //the last stage is evaluated at the 5th order solution itself (a[6] = b), so the k[6] of an
+        //accepted step is the k[0] of the next one, unless the state was moved in between
+        std::array<StateVector, 7> k;
+        k[0] = has_last_derivative && last_derivative_at.x == x.x ? last_derivative : derivative(x);
+        while (true)
+        {
+            auto step = std::min(h, t_end - time);
+
+            StateVector stage;
+            for (int s = 1; s < 7; s++)
+            {
+                stage = x;
+                for (int j = 0; j < s; j++)
+                {
+                    for (int i = 0; i < 4; i++)
+                    {
+                        stage[i] += step * a[s][j] * k[j][i];
+                    }
+                }
+                k[s] = derivative(stage);
+            }
+
+            long double error = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                long double local = 0;
+                for (int j = 0; j < 7; j++)
+                {
+                    local += e[j] * k[j][i];
+                }
+                auto scale = params->atol + params->rtol * std::max(std::abs(x[i]), std::abs(stage[i]));
+                error += std::pow(step * local / scale, 2);
+            }
+            error = std::sqrt(error / 4);
+
+            auto factor = error > 0 ? 0.9L * std::pow(error, -0.2L) : 5.0L;
+            if (error <= 1)
+            {
+                accepted++;
+                last_derivative = k[6];
+                last_derivative_at = stage;
+                has_last_derivative = true;
+                update(time + step, to_state(stage));
+                //a step clipped at t_end says nothing about the natural step size
+                if (step == h)
+                {
+                    h = step * std::min(5.0L, std::max(0.2L, factor));
+                }
+                return;
+            }
+            rejected++;
+            h = step * std::max(0.2L, factor);
+        }
     }
 
-    void advance_runge(Time &t)
+    /**
+     * crash / pass test of the step that started in `before` at t_before.
+     * with params->locate_events the step is interpolated and the first crossing inside it is
+     * found, including grazes that leave the filter region and come back within one step;
+     * the particle then ends exactly on the crossing instead of up to one step later.
+     */
+    void check_boundaries(const State &before, Time t_before)
     {
-        //take last state
-        auto last_state = (--history.end())->second;
-
-        //calculate velocity
-        auto k1 = K1(v, last_state);
-        auto k2 = K2(v, k1, last_state);
-        auto k3 = K3(v, k2, last_state);
-        auto k4 = K4(v, k3, last_state);
-        auto v = last_state.v + (((long double) 1 / 6) * (k1 + (k2 * 2) + (k3 * 2) + (k4 * 2)));
-
-        //calculate position
-        k1 = K1(r, last_state);
-        k2 = K2(r, k1, last_state);
-        k3 = K3(r, k2, last_state);
-        k4 = K4(r, k3, last_state);
-        auto r = last_state.r + (((long double) 1 / 6) * (k1 + (k2 * 2) + (k3 * 2) + (k4 * 2)));
+        INSTRUMENT_HOT_PHASE(BOUNDARY_CHECK);
+        if (params->locate_events)
+        {
+            auto x0 = to_vector(before);
+            auto x1 = to_vector(state);
+            auto h = time - t_before;
+            StepInterpolant step(x0, derivative(x0), x1, derivative(x1), h);
+            auto crossing = locate_crossing(step, params->R, params->L);
+            if (crossing.found)
+            {
+                crashed = crossing.crashed;
+                passed = !crossing.crashed;
+                auto t = t_before + crossing.s * h;
+                state = to_state(step(crossing.s));
+                time = t;
+                history.revise(t, state);
+                return;
+            }
+            //no root inside the step but outside at its end: only rounding, the endpoint test
+            //below decides, as refine_lane does in the ensemble
+        }
 
-        //insert new data
-        history[t] = {r, v};
+        //check if crashed
+        auto new_pos = state;
+        if ((std::abs(new_pos.r.y()) >= params->R) && (new_pos.r.z() <= params->L))
+        {
+            crashed = true;
+            return;
+        }
+
+        //check if passed
+        if ((new_pos.r.z() > params->L))
+        {
+            passed = true;
+        }
     }
 
     void advance(Time &t)
     {
+        auto before = state;
+        auto t_before = time;
+
         switch (params->method)
         {
             case TAYLOR:
-                advance_taylor(t);
+                advance_tableau<EULER_TABLEAU>(t);
                 break;
             case MIDPOINT:
-                advance_midpoint(t);
+                advance_tableau<MIDPOINT_TABLEAU>(t);
                 break;
             case RUNGE_KUTTA:
-                advance_runge(t);
+                advance_tableau<RK4_TABLEAU>(t);
+                break;
+            case SSPRK3:
+                advance_tableau<SSPRK3_TABLEAU>(t);
+                break;
+            case RK6:
+                advance_tableau<RK6_TABLEAU>(t);
+                break;
+            case ANALYTIC:
+                advance_analytic(t);
+                break;
+            case BORIS:
+                advance_boris(t);
+                break;
+            case DORMAND_PRINCE:
+                while (time < t)
+                {
+                    advance_dormand_prince(t);
+                }
                 break;
         }
 
-        //check if crashed
-        auto new_pos = (--history.end())->second;
-        if ((std::abs(new_pos.r.y()) >= params->R) && (new_pos.r.z() <= params->L))
+        check_boundaries(before, t_before);
+    }
+
+    /**
+     * advance the particle through a whole stage, or by at most max_steps steps. a particle that
+     * stopped early carries on from where it is on the next call, exactly as if it had not stopped;
+     * `done` is set once the stage is complete.
+     * returns true if the particle crashed into the filter.
+     */
+    bool run(char stage, unsigned long max_steps = std::numeric_limits<unsigned long>::max())
+    {
+        INSTRUMENT_PARTICLE(history.steps, crashed, passed);
+        if (params->method == ANALYTIC)
         {
-            crashed = true;
-            return;
+            if (params->fields)
+            {
+                throw std::invalid_argument("the analytic solution needs uniform fields");
+            }
+            if (stage == 'b')
+            {
+                //straight to the time of the last fixed step before T
+                Time t = (std::ceil(params->T / params->dt) - 1) * params->dt;
+                advance_analytic(t);
+            }
+            else if (stage == 'c')
+            {
+                classify_analytic();
+            }
+            done = true;
+            return crashed;
         }
 
-        //check if passed
-        if ((new_pos.r.z() > params->L))
+        if (params->method == DORMAND_PRINCE)
         {
-            passed = true;
+            unsigned long taken = 0;
+            if (stage == 'b')
+            {
+                while (time < params->T)
+                {
+                    if (taken++ == max_steps)
+                    {
+                        return crashed;
+                    }
+                    advance_dormand_prince(params->T);
+                }
+            }
+            else if (stage == 'c')
+            {
+                while (!crashed && !passed)
+                {
+                    if (taken++ == max_steps)
+                    {
+                        return crashed;
+                    }
+                    auto before = state;
+                    auto t_before = time;
+                    advance_dormand_prince(NEVER);
+                    check_boundaries(before, t_before);
+                }
+            }
+            done = true;
+            return crashed;
         }
 
+        //the method is chosen once here, the stepping loops below carry no dispatch
+        return with_fixed_step([&](auto &&step) { return run_fixed(stage, step, max_steps); });
     }
 
-    void export_history_to_excel(const std::string &str = "")
+    /**
+     * exactly n fixed steps of params->dt, the i-th of them ending at (first + i) * dt.
+     * no boundary checks; meant for convergence runs that compare final states.
+     */
+    void run_steps(std::size_t first, std::size_t n)
     {
-        std::vector<std::string> method_names{"TAYLOR", "MIDPOINT", "RUNGE_KUTTA"};
-        std::ostringstream oss;
-        oss << method_names[params->method] << str << ".csv";
-        std::string filename = oss.str();
+        with_fixed_step([&](auto &&step) {
+            for (std::size_t i = 1; i <= n; i++)
+            {
+                Time t = (first + i) * params->dt;
+                step(t);
+            }
+            return false;
+        });
+    }
 
-        std::ofstream output_csv;
-        output_csv.open(filename);
+    /**
+     * calls f(step) with the single-step function of the fixed-step method in params,
+     * so the loop inside f is compiled once per method
+     */
+    template<typename Function>
+    bool with_fixed_step(Function &&f)
+    {
+        switch (params->method)
+        {
+            case TAYLOR:
+                return f([this](Time &t) { advance_tableau<EULER_TABLEAU>(t); });
+            case MIDPOINT:
+                return f([this](Time &t) { advance_tableau<MIDPOINT_TABLEAU>(t); });
+            case RUNGE_KUTTA:
+                return f([this](Time &t) { advance_tableau<RK4_TABLEAU>(t); });
+            case SSPRK3:
+                return f([this](Time &t) { advance_tableau<SSPRK3_TABLEAU>(t); });
+            case RK6:
+                return f([this](Time &t) { advance_tableau<RK6_TABLEAU>(t); });
+            case BORIS:
+                return f([this](Time &t) { advance_boris(t); });
+            default:
+                return false;
+        }
+    }
 
-        output_csv << "y" << "," << "z" << "," << "vy" << "," << "vz" << "\n";
-        for (auto &moment: history)
+    template<typename Step>
+    bool run_fixed(char stage, Step &&step, unsigned long max_steps)
+    {
+        //every step ends dt after the previous one, so a run resumed at `time` repeats the same t values
+        unsigned long taken = 0;
+        if (stage == 'b')
+        {
+            for (Time t = time + params->dt; t < params->T; t += params->dt)
+            {
+                if (taken++ == max_steps)
+                {
+                    return false;
+                }
+                //advance particle
+                step(t);
+            }
+        }
+        else if (stage == 'c')
         {
-            output_csv << moment.second.r.y() << "," << moment.second.r.z() << ",";
-            output_csv << moment.second.v.y() << "," << moment.second.v.z() << "\n";
+            Time t = time + params->dt;
+            while (true)
+            {
+                if (taken++ == max_steps)
+                {
+                    return false;
+                }
+                //advance particle
+                auto before = state;
+                auto t_before = time;
+                step(t);
+                check_boundaries(before, t_before);
+
+                //check if particle crashed into the filter
+                if (crashed)
+                {
+                    done = true;
+                    return true;
+                }
+
+                //check if particle passed the filter
+                if (passed)
+                {
+                    break;
+                }
+
+                t += params->dt;
+            }
         }
-        output_csv.close();
+        done = true;
+        return false;
+    }
+
+    /**
+     * everything run() needs to carry on bit for bit: state, time, flags, step size control and history
+     */
+    void save(ByteWriter &out) const
+    {
+        out.put(state);
+        out.put(time);
+        out.put(h);
+        out.put<std::uint64_t>(accepted);
+        out.put<std::uint64_t>(rejected);
+        out.put<std::uint8_t>(crashed | passed << 1 | done << 2);
+        history.save(out);
+    }
+
+    void restore(ByteReader &in)
+    {
+        state = in.get_state();
+        time = in.get<Time>();
+        h = in.get<Time>();
+        accepted = in.get<std::uint64_t>();
+        rejected = in.get<std::uint64_t>();
+        auto flags = in.get<std::uint8_t>();
+        crashed = flags & 1;
+        passed = flags & 2;
+        done = flags & 4;
+        history.restore(in);
+    }
+
+    /**
+     * kept samples as columns y, z, vy, vz, t
+     */
+    ColumnTable trajectory_table() const
+    {
+        ColumnTable table({"y", "z", "vy", "vz", "t"});
+        table.reserve(history.samples.size() + 2);
+        history.for_each([&](const Sample &moment) {
+            table.add_row({(double) moment.state.r.y(), (double) moment.state.r.z(), (double) moment.state.v.y(),
+                           (double) moment.state.v.z(), (double) moment.t});
+        });
+        return table;
+    }
+
+    /**
+     * writes the trajectory to `filename`, the format follows the extension (see write_table)
+     */
+    void export_history(const std::string &filename, const RunInfo &info) const
+    {
+        write_table(filename, trajectory_table(), info);
+    }
+
+    std::string excel_filename(const std::string &str = "") const
+    {
+        return method_name(params->method) + str + ".csv";
+    }
+
+    void export_history_to_excel(const std::string &str = "") const
+    {
+        write_csv(excel_filename(str), trajectory_table());
     }
 };
 
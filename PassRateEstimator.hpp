@@ -0,0 +1,133 @@
+#ifndef NUMERICAL_CPP_PASSRATEESTIMATOR_HPP
+#define NUMERICAL_CPP_PASSRATEESTIMATOR_HPP
+
+#include "Simulation.hpp"
+#include "Ensemble.hpp"
+#include "Random.hpp"
+#include "Precision.hpp"
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#define DEFAULT_BATCH_SIZE 16384
+#define DEFAULT_TARGET_HALF_WIDTH 0.1     //percent
+#define Z_95 1.959963984540054            //two-sided 95 % normal quantile
+
+class PassRateEstimate
+{
+public:
+    long double estimate = 0;       //pass percentage
+    long double half_width = 0;     //of the confidence interval, in percent
+    long double lower = 0;
+    long double upper = 100;
+    unsigned long particles = 0;
+    unsigned long passed = 0;
+    std::size_t batches = 0;
+    double seconds = 0;
+    bool converged = false;         //false if the time budget or the particle limit ran out first
+};
+
+/**
+ * Wilson score interval of a binomial proportion, in percent.
+ * unlike the normal approximation it stays inside [0, 100] and behaves for rates near 0 or 1.
+ */
+static void wilson_interval(unsigned long successes, unsigned long n, long double z, PassRateEstimate &result)
+{
+    if (n == 0)
+    {
+        return;
+    }
+    long double p = (long double) successes / n;
+    long double z2n = z * z / n;
+    long double centre = (p + z2n / 2) / (1 + z2n);
+    long double half = z / (1 + z2n) * std::sqrt(p * (1 - p) / n + z2n / (4 * n));
+    result.estimate = 100 * p;
+    result.half_width = 100 * half;
+    result.lower = 100 * (centre - half);
+    result.upper = 100 * (centre + half);
+}
+
+/**
+ * Sequential Monte Carlo estimate of the stage-c pass percentage.
+ * Particles are streamed in batches through one reused ensemble; batch b holds particles
+ * [b * batch_size, (b + 1) * batch_size) of the (seed, run id) stream, the same particles a
+ * Simulation of that size would draw. After every batch the Wilson interval is updated and the
+ * run stops as soon as its half-width is at most target_half_width, or when the time budget or
+ * max_particles runs out. (Stopping on the observed width makes the coverage slightly lower than
+ * nominal; with thousands of particles per batch the difference is negligible.)
+ */
+class PassRateEstimator
+{
+public:
+    ProblemParameters *params;
+    std::uint64_t seed;
+    std::uint32_t run_id;
+    std::size_t batch_size = DEFAULT_BATCH_SIZE;
+    long double target_half_width = DEFAULT_TARGET_HALF_WIDTH;
+    long double z = Z_95;
+    double time_budget = std::numeric_limits<double>::infinity();   //seconds
+    unsigned long max_particles = std::numeric_limits<unsigned long>::max();
+    unsigned n_threads = 1;
+
+    PassRateEstimator(ProblemParameters *params, std::uint64_t seed = DEFAULT_SEED, std::uint32_t run_id = 0)
+            : params(params), seed(seed), run_id(run_id)
+    {}
+
+    PassRateEstimate run()
+    {
+        switch (params->precision)
+        {
+            case FLOAT:
+                return run_as<float>();
+            case LONG_DOUBLE:
+                return run_as<long double>();
+            case DOUBLE_DOUBLE:
+                return run_as<DoubleDouble>();
+            default:
+                return run_as<double>();
+        }
+    }
+
+private:
+    template<typename Real>
+    PassRateEstimate run_as()
+    {
+        auto start = std::chrono::steady_clock::now();
+        BasicEnsemble<Real> ensemble(0, params);
+        Ensemble::Column y0(batch_size), vz0(batch_size);
+        PassRateEstimate result;
+
+        while (result.particles < max_particles)
+        {
+            std::size_t n = (std::size_t) std::min<unsigned long>(batch_size, max_particles - result.particles);
+            fill_initial_conditions(*params, seed, run_id, y0.data(), vz0.data(), result.particles, n);
+            ensemble.reset(n, params);
+            for (std::size_t i = 0; i < n; i++)
+            {
+                ensemble.set(i, {{y0[i], 0},
+                                 {0,     vz0[i]}});
+            }
+            ensemble.run('c', n_threads);
+
+            result.particles += n;
+            result.passed += n - ensemble.crash_counter;
+            result.batches++;
+            wilson_interval(result.passed, result.particles, z, result);
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if (result.half_width <= target_half_width)
+            {
+                result.converged = true;
+                break;
+            }
+            if (result.seconds >= time_budget)
+            {
+                break;
+            }
+        }
+        return result;
+    }
+};
+
+
+#endif //NUMERICAL_CPP_PASSRATEESTIMATOR_HPP
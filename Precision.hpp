@@ -0,0 +1,328 @@
+#ifndef NUMERICAL_CPP_PRECISION_HPP
+#define NUMERICAL_CPP_PRECISION_HPP
+
+#include "ProblemParameters.hpp"
+#include <experimental/simd>
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <stdexcept>
+#include <utility>
+#include <tuple>
+#include <type_traits>
+
+namespace stdx = std::experimental;
+
+//inline rather than static: bench includes this header but never parses a name
+inline PRECISION parse_precision(const std::string &name)
+{
+    if (name == "float")
+    {
+        return FLOAT;
+    }
+    if (name == "long")
+    {
+        return LONG_DOUBLE;
+    }
+    if (name == "dd")
+    {
+        return DOUBLE_DOUBLE;
+    }
+    if (name == "double")
+    {
+        return DOUBLE;
+    }
+    throw std::invalid_argument("unknown precision '" + name + "', expected float, double, long or dd");
+}
+
+/**
+ * Unevaluated sum hi + lo of two doubles, about 106 bits of mantissa (Dekker, Knuth).
+ * Used for high-precision reference runs; it does not vectorize.
+ */
+class DoubleDouble
+{
+public:
+    double hi = 0;
+    double lo = 0;
+
+    DoubleDouble() = default;
+
+    DoubleDouble(double x) : hi(x)
+    {}
+
+    DoubleDouble(double hi, double lo) : hi(hi), lo(lo)
+    {}
+
+    DoubleDouble(long double x) : hi((double) x), lo((double) (x - (long double) (double) x))
+    {}
+
+    DoubleDouble(int x) : hi(x)
+    {}
+
+    explicit operator long double() const
+    {
+        return (long double) hi + lo;
+    }
+
+    explicit operator double() const
+    {
+        return hi + lo;
+    }
+
+    friend DoubleDouble operator+(const DoubleDouble &a, const DoubleDouble &b)
+    {
+        auto [s, e] = two_sum(a.hi, b.hi);
+        auto [t, f] = two_sum(a.lo, b.lo);
+        e += t;
+        std::tie(s, e) = quick_two_sum(s, e);
+        e += f;
+        auto [hi, lo] = quick_two_sum(s, e);
+        return {hi, lo};
+    }
+
+    friend DoubleDouble operator-(const DoubleDouble &a)
+    {
+        return {-a.hi, -a.lo};
+    }
+
+    friend DoubleDouble operator-(const DoubleDouble &a, const DoubleDouble &b)
+    {
+        return a + (-b);
+    }
+
+    friend DoubleDouble operator*(const DoubleDouble &a, const DoubleDouble &b)
+    {
+        auto [p, e] = two_prod(a.hi, b.hi);
+        e += a.hi * b.lo + a.lo * b.hi;
+        auto [hi, lo] = quick_two_sum(p, e);
+        return {hi, lo};
+    }
+
+    friend DoubleDouble operator/(const DoubleDouble &a, const DoubleDouble &b)
+    {
+        auto q1 = a.hi / b.hi;
+        auto r = a - b * q1;
+        auto q2 = r.hi / b.hi;
+        r = r - b * q2;
+        auto q3 = r.hi / b.hi;
+        auto [hi, lo] = quick_two_sum(q1, q2);
+        return DoubleDouble(hi, lo) + q3;
+    }
+
+    DoubleDouble &operator+=(const DoubleDouble &other)
+    {
+        return *this = *this + other;
+    }
+
+    DoubleDouble &operator-=(const DoubleDouble &other)
+    {
+        return *this = *this - other;
+    }
+
+    friend bool operator<(const DoubleDouble &a, const DoubleDouble &b)
+    {
+        return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+    }
+
+    friend bool operator>(const DoubleDouble &a, const DoubleDouble &b)
+    {
+        return b < a;
+    }
+
+    friend bool operator<=(const DoubleDouble &a, const DoubleDouble &b)
+    {
+        return !(b < a);
+    }
+
+    friend bool operator>=(const DoubleDouble &a, const DoubleDouble &b)
+    {
+        return !(a < b);
+    }
+
+private:
+    static std::pair<double, double> two_sum(double a, double b)
+    {
+        auto s = a + b;
+        auto bb = s - a;
+        return {s, (a - (s - bb)) + (b - bb)};
+    }
+
+    static std::pair<double, double> quick_two_sum(double a, double b)
+    {
+        auto s = a + b;
+        return {s, b - (s - a)};
+    }
+
+    static std::pair<double, double> two_prod(double a, double b)
+    {
+        auto p = a * b;
+        return {p, std::fma(a, b, -p)};
+    }
+};
+
+static DoubleDouble abs(const DoubleDouble &a)
+{
+    return a.hi < 0 ? -a : a;
+}
+
+/**
+ * How the ensemble kernels see a block of particles for a given scalar type:
+ * float and double fill a native SIMD register (AVX2: 8 / 4 lanes, AVX-512: 16 / 8 lanes),
+ * long double and double-double run one particle per block.
+ */
+template<typename Real>
+class LanePolicy
+{
+public:
+    typedef stdx::native_simd<Real> Lanes;
+    typedef stdx::native_simd_mask<Real> Mask;
+
+    static constexpr std::size_t size = Lanes::size();
+
+    static Lanes load(const Real *p)
+    {
+        return Lanes(p, stdx::vector_aligned);
+    }
+
+    static void store(const Lanes &x, Real *p)
+    {
+        x.copy_to(p, stdx::vector_aligned);
+    }
+
+    static Lanes iota()
+    {
+        return Lanes([](auto i) { return (Real) (std::size_t) i; });
+    }
+
+    //lanes filled with f(0) .. f(size - 1), e.g. values gathered from scattered addresses
+    template<typename F>
+    static Lanes generate(F &&f)
+    {
+        return Lanes([&](auto i) { return (Real) f((std::size_t) i); });
+    }
+
+    static Lanes abs(const Lanes &x)
+    {
+        return stdx::abs(x);
+    }
+
+    static Lanes min(const Lanes &a, const Lanes &b)
+    {
+        return stdx::min(a, b);
+    }
+
+    static Lanes max(const Lanes &a, const Lanes &b)
+    {
+        return stdx::max(a, b);
+    }
+
+    //x = v in the lanes selected by m
+    static void blend(const Mask &m, Lanes &x, const Lanes &v)
+    {
+        stdx::where(m, x) = v;
+    }
+
+    static bool any(const Mask &m)
+    {
+        return stdx::any_of(m);
+    }
+
+    static std::size_t count(const Mask &m)
+    {
+        return stdx::popcount(m);
+    }
+};
+
+template<>
+class LanePolicy<DoubleDouble>
+{
+public:
+    typedef DoubleDouble Lanes;
+    typedef bool Mask;
+
+    static constexpr std::size_t size = 1;
+
+    static Lanes load(const DoubleDouble *p)
+    {
+        return *p;
+    }
+
+    static void store(const Lanes &x, DoubleDouble *p)
+    {
+        *p = x;
+    }
+
+    static Lanes iota()
+    {
+        return 0;
+    }
+
+    template<typename F>
+    static Lanes generate(F &&f)
+    {
+        return f(0);
+    }
+
+    static Lanes abs(const Lanes &x)
+    {
+        return ::abs(x);
+    }
+
+    static Lanes min(const Lanes &a, const Lanes &b)
+    {
+        return b < a ? b : a;
+    }
+
+    static Lanes max(const Lanes &a, const Lanes &b)
+    {
+        return a < b ? b : a;
+    }
+
+    static void blend(Mask m, Lanes &x, const Lanes &v)
+    {
+        if (m)
+        {
+            x = v;
+        }
+    }
+
+    static bool any(Mask m)
+    {
+        return m;
+    }
+
+    static std::size_t count(Mask m)
+    {
+        return m;
+    }
+};
+
+//element access that works for SIMD registers and for the one-lane scalar policies alike
+template<typename T>
+static auto lane_of(const T &x, std::size_t lane)
+{
+    if constexpr (requires { x[lane]; })
+    {
+        return x[lane];
+    }
+    else
+    {
+        return x;
+    }
+}
+
+template<typename T, typename V>
+static void set_lane(T &x, std::size_t lane, const V &value)
+{
+    if constexpr (requires { x[lane]; })
+    {
+        x[lane] = value;
+    }
+    else
+    {
+        x = value;
+    }
+}
+
+
+#endif //NUMERICAL_CPP_PRECISION_HPP
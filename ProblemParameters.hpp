@@ -5,17 +5,60 @@
 #include <iostream>
 #include "cmath"
 #include <map>
+#include <cstddef>
 
 #define NUM_PERIODS 1
 #define DEFAULT_DT 0.01
+#define DEFAULT_TOLERANCE 1e-10
 
 enum METHOD
 {
     TAYLOR,
     MIDPOINT,
-    RUNGE_KUTTA
+    RUNGE_KUTTA,
+    ANALYTIC,       //closed-form solution of the uniform crossed fields
+    DORMAND_PRINCE, //adaptive embedded Runge-Kutta 5(4)
+    BORIS,          //Boris pusher, volume preserving
+    SSPRK3,         //strong-stability-preserving Runge-Kutta 3
+    RK6             //Butcher's sixth order Runge-Kutta
 };
 
+enum RECORD
+{
+    FINAL_ONLY,     //initial and final state
+    LAST_N,         //ring buffer of the last record_capacity states
+    EVERY_K,        //every record_stride-th step
+    FULL            //every step
+};
+
+//how the random initial conditions of stage c are drawn
+enum SAMPLING
+{
+    PSEUDO_RANDOM,  //independent Philox draws
+    SOBOL           //scrambled Sobol points, one randomized replicate per run id
+};
+
+static std::string method_name(METHOD method)
+{
+    const char *names[] = {"TAYLOR", "MIDPOINT", "RUNGE_KUTTA", "ANALYTIC", "DORMAND_PRINCE", "BORIS", "SSPRK3", "RK6"};
+    return names[method];
+}
+
+#ifndef DEFAULT_PRECISION
+#define DEFAULT_PRECISION DOUBLE
+#endif
+
+//arithmetic of the ensemble kernels
+enum PRECISION
+{
+    FLOAT,
+    DOUBLE,
+    LONG_DOUBLE,
+    DOUBLE_DOUBLE
+};
+
+class FieldMap;
+
 class ProblemParameters
 {
 public:
@@ -29,6 +72,15 @@ public:
     long double R;
     long double L;
     METHOD method;
+    RECORD record = FULL;
+    std::size_t record_capacity = 1024;
+    std::size_t record_stride = 1;
+    long double atol = DEFAULT_TOLERANCE;     //absolute / relative error tolerance of adaptive methods
+    long double rtol = DEFAULT_TOLERANCE;
+    bool locate_events = false;     //find the exact wall / exit crossing inside the last step
+    PRECISION precision = DEFAULT_PRECISION;
+    SAMPLING sampling = PSEUDO_RANDOM;
+    const FieldMap *fields = nullptr;   //E(y, z) and B(y, z) instead of the uniform E and B, not owned
 
     ProblemParameters() : ProblemParameters(1, 1, 1, 1, DEFAULT_DT, 1, 1, TAYLOR)
     {}
@@ -0,0 +1,202 @@
+#ifndef NUMERICAL_CPP_RANDOM_HPP
+#define NUMERICAL_CPP_RANDOM_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+#define DEFAULT_SEED 20220617ULL
+
+/**
+ * Philox4x32-10 counter-based generator (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+ * The output is a pure function of (seed, run id, particle index, block), so any thread can draw
+ * any particle's numbers on its own, in any order, and always get the same bits.
+ * One block gives four 32 bit words, i.e. two uniform doubles per particle.
+ */
+class CounterRng
+{
+public:
+    typedef std::array<std::uint32_t, 4> Block;
+
+    std::uint64_t seed;
+    std::uint32_t run_id;
+
+    explicit CounterRng(std::uint64_t seed = DEFAULT_SEED, std::uint32_t run_id = 0) : seed(seed), run_id(run_id)
+    {}
+
+    Block block(std::uint64_t index, std::uint32_t block_id = 0) const
+    {
+        return philox({(std::uint32_t) index, (std::uint32_t) (index >> 32), block_id, run_id},
+                      {(std::uint32_t) seed, (std::uint32_t) (seed >> 32)});
+    }
+
+    /**
+     * uniform double in [0, 1) from word pair `sample` (0 or 1) of the particle's block
+     */
+    double uniform(std::uint64_t index, unsigned sample, std::uint32_t block_id = 0) const
+    {
+        auto words = block(index, block_id);
+        return to_unit(words[2 * sample], words[2 * sample + 1]);
+    }
+
+    double uniform(std::uint64_t index, unsigned sample, double min, double max, std::uint32_t block_id = 0) const
+    {
+        return min + (max - min) * uniform(index, sample, block_id);
+    }
+
+    /**
+     * fills column[0, n) with the samples of particles first..first+n-1 scaled to [min, max).
+     * the loop body is branch-free integer arithmetic, so it vectorizes over particles and the
+     * values are bit-identical to calling uniform() per particle.
+     */
+    void fill_uniform(double *column, std::uint64_t first, std::size_t n, unsigned sample,
+                      double min, double max, std::uint32_t block_id = 0) const
+    {
+        for (std::size_t i = 0; i < n; i++)
+        {
+            auto words = block(first + i, block_id);
+            column[i] = min + (max - min) * to_unit(words[2 * sample], words[2 * sample + 1]);
+        }
+    }
+
+    /**
+     * fills both samples of particles first..first+n-1 at once, sample 0 into first_column scaled to
+     * [min0, max0) and sample 1 into second_column scaled to [min1, max1): one Philox block per
+     * particle instead of one per column. same values as two single-column calls.
+     */
+    void fill_uniform(double *first_column, double *second_column, std::uint64_t first, std::size_t n,
+                      double min0, double max0, double min1, double max1, std::uint32_t block_id = 0) const
+    {
+        for (std::size_t i = 0; i < n; i++)
+        {
+            auto words = block(first + i, block_id);
+            first_column[i] = min0 + (max0 - min0) * to_unit(words[0], words[1]);
+            second_column[i] = min1 + (max1 - min1) * to_unit(words[2], words[3]);
+        }
+    }
+
+    static double to_unit(std::uint32_t lo, std::uint32_t hi)
+    {
+        //top 53 bits of the 64 bit word
+        auto bits = ((std::uint64_t) hi << 32) | lo;
+        return (double) (bits >> 11) * 0x1.0p-53;
+    }
+
+private:
+    static constexpr std::uint32_t M0 = 0xD2511F53;
+    static constexpr std::uint32_t M1 = 0xCD9E8D57;
+    static constexpr std::uint32_t W0 = 0x9E3779B9;
+    static constexpr std::uint32_t W1 = 0xBB67AE85;
+
+    static Block philox(Block counter, std::array<std::uint32_t, 2> key)
+    {
+        for (int round = 0; round < 10; round++)
+        {
+            auto p0 = (std::uint64_t) M0 * counter[0];
+            auto p1 = (std::uint64_t) M1 * counter[2];
+            counter = {(std::uint32_t) (p1 >> 32) ^ counter[1] ^ key[0], (std::uint32_t) p1,
+                       (std::uint32_t) (p0 >> 32) ^ counter[3] ^ key[1], (std::uint32_t) p0};
+            key[0] += W0;
+            key[1] += W1;
+        }
+        return counter;
+    }
+};
+
+/**
+ * Two-dimensional Sobol sequence with hash-based Owen scrambling (Burley, "Practical hash-based
+ * Owen scrambling", 2020). Point i is computed directly from the bits of i, so any thread can
+ * evaluate any point. The scrambling keeps the net structure of the sequence, and each
+ * (seed, run id) pair gives an independent randomized replicate, so the spread over run ids
+ * estimates the error of the quasi-Monte Carlo integral.
+ */
+class ScrambledSobol
+{
+public:
+    static constexpr unsigned dimensions = 2;
+
+    explicit ScrambledSobol(std::uint64_t seed = DEFAULT_SEED, std::uint32_t run_id = 0)
+    {
+        //a block id the particle draws never use
+        auto words = CounterRng(seed, run_id).block(0, SOBOL_SCRAMBLE_BLOCK);
+        scramble = {words[0], words[1]};
+        shuffle = words[2];
+    }
+
+    /**
+     * coordinate `dimension` (0 or 1) of point `index`, in [0, 1)
+     */
+    double uniform(std::uint64_t index, unsigned dimension) const
+    {
+        //the index is Owen-scrambled too, so every prefix of the sequence is a random sample of points
+        auto i = nested_uniform_scramble((std::uint32_t) index, shuffle);
+        std::uint32_t x = 0;
+        for (unsigned bit = 0; i; bit++, i >>= 1)
+        {
+            if (i & 1)
+            {
+                x ^= DIRECTIONS[dimension][bit];
+            }
+        }
+        x = nested_uniform_scramble(x, scramble[dimension]);
+        return ((double) x + 0.5) * 0x1.0p-32;
+    }
+
+    void fill_uniform(double *column, std::uint64_t first, std::size_t n, unsigned dimension,
+                      double min, double max) const
+    {
+        for (std::size_t i = 0; i < n; i++)
+        {
+            column[i] = min + (max - min) * uniform(first + i, dimension);
+        }
+    }
+
+private:
+    static constexpr std::uint32_t SOBOL_SCRAMBLE_BLOCK = 0x50B0150Bu;
+
+    //direction numbers v_k = m_k 2^(32 - k): dimension 0 is van der Corput, dimension 1 has the
+    //primitive polynomial x + 1, i.e. m_1 = 1 and m_k = 2 m_(k-1) xor m_(k-1)
+    static constexpr std::array<std::array<std::uint32_t, 32>, 2> DIRECTIONS = [] {
+        std::array<std::array<std::uint32_t, 32>, 2> v{};
+        std::uint32_t m = 1;
+        for (unsigned k = 0; k < 32; k++)
+        {
+            v[0][k] = 1u << (31 - k);
+            v[1][k] = m << (31 - k);
+            m = (m << 1) ^ m;
+        }
+        return v;
+    }();
+
+    std::array<std::uint32_t, 2> scramble;
+    std::uint32_t shuffle;
+
+    static std::uint32_t reverse_bits(std::uint32_t x)
+    {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+        x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    //Laine-Karras hash: flipping a bit only ever depends on the bits below it
+    static std::uint32_t laine_karras_permutation(std::uint32_t x, std::uint32_t seed)
+    {
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return x;
+    }
+
+    //applied to the reversed bits, so each bit is flipped depending on the more significant ones: Owen scrambling
+    static std::uint32_t nested_uniform_scramble(std::uint32_t x, std::uint32_t seed)
+    {
+        return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+    }
+};
+
+
+#endif //NUMERICAL_CPP_RANDOM_HPP
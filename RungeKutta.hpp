@@ -0,0 +1,112 @@
+#ifndef NUMERICAL_CPP_RUNGEKUTTA_HPP
+#define NUMERICAL_CPP_RUNGEKUTTA_HPP
+
+#include "ProblemParameters.hpp"
+#include <array>
+#include <cstddef>
+#include <utility>
+
+/**
+ * Explicit Runge-Kutta scheme: k_i = f(x + h * sum_j a[i][j] k_j), x' = x + h * sum_i b[i] k_i.
+ * The fields are constexpr, so the stage loop of rk_step is unrolled and zero coefficients
+ * disappear at compile time. The ODE here is autonomous, so the nodes c are not needed.
+ */
+template<std::size_t S>
+class ButcherTableau
+{
+public:
+    static constexpr std::size_t stages = S;
+    std::array<std::array<long double, S>, S> a;
+    std::array<long double, S> b;
+};
+
+constexpr ButcherTableau<1> EULER_TABLEAU{{{{0}}},
+                                          {1}};
+
+constexpr ButcherTableau<2> MIDPOINT_TABLEAU{{{{0, 0},
+                                                {0.5L, 0}}},
+                                             {0, 1}};
+
+constexpr ButcherTableau<4> RK4_TABLEAU{{{{0, 0, 0, 0},
+                                           {0.5L, 0, 0, 0},
+                                           {0, 0.5L, 0, 0},
+                                           {0, 0, 1, 0}}},
+                                        {1.0L / 6, 1.0L / 3, 1.0L / 3, 1.0L / 6}};
+
+//strong-stability-preserving third order scheme of Shu and Osher
+constexpr ButcherTableau<3> SSPRK3_TABLEAU{{{{0, 0, 0},
+                                              {1, 0, 0},
+                                              {0.25L, 0.25L, 0}}},
+                                           {1.0L / 6, 1.0L / 6, 2.0L / 3}};
+
+//Butcher's sixth order scheme with seven stages
+constexpr ButcherTableau<7> RK6_TABLEAU{{{{0, 0, 0, 0, 0, 0, 0},
+                                           {1.0L / 3, 0, 0, 0, 0, 0, 0},
+                                           {0, 2.0L / 3, 0, 0, 0, 0, 0},
+                                           {1.0L / 12, 1.0L / 3, -1.0L / 12, 0, 0, 0, 0},
+                                           {-1.0L / 16, 9.0L / 8, -3.0L / 16, -3.0L / 8, 0, 0, 0},
+                                           {0, 9.0L / 8, -3.0L / 8, -3.0L / 4, 0.5L, 0, 0},
+                                           {9.0L / 44, -9.0L / 11, 63.0L / 44, 18.0L / 11, 0, -16.0L / 11, 0}}},
+                                        {11.0L / 120, 0, 27.0L / 40, 27.0L / 40, -4.0L / 15, -4.0L / 15,
+                                         11.0L / 120}};
+
+/**
+ * tableau of every fixed-step METHOD that is a plain explicit Runge-Kutta scheme
+ */
+template<METHOD method>
+class MethodTableau
+{
+public:
+    static constexpr bool exists = false;
+};
+
+#define METHOD_TABLEAU(METHOD_NAME, TABLEAU)                        \
+    template<>                                                      \
+    class MethodTableau<METHOD_NAME>                                \
+    {                                                               \
+    public:                                                         \
+        static constexpr bool exists = true;                        \
+        static constexpr const auto &tableau = TABLEAU;             \
+    };
+
+METHOD_TABLEAU(TAYLOR, EULER_TABLEAU)
+METHOD_TABLEAU(MIDPOINT, MIDPOINT_TABLEAU)
+METHOD_TABLEAU(RUNGE_KUTTA, RK4_TABLEAU)
+METHOD_TABLEAU(SSPRK3, SSPRK3_TABLEAU)
+METHOD_TABLEAU(RK6, RK6_TABLEAU)
+
+/**
+ * x + h * sum_{j < i} w[j] k[j], skipping zero weights at compile time
+ */
+template<const auto &weights, std::size_t n, typename Vector, typename Scalar, std::size_t S>
+static Vector rk_combine(const Vector &x, Scalar h, const std::array<Vector, S> &k)
+{
+    Vector result = x;
+    [&]<std::size_t... j>(std::index_sequence<j...>) {
+        ([&] {
+            if constexpr (weights[j] != 0)
+            {
+                result = result + (h * (Scalar) weights[j]) * k[j];
+            }
+        }(), ...);
+    }(std::make_index_sequence<n>{});
+    return result;
+}
+
+/**
+ * one step of the scheme in `tableau` for dx/dt = f(x).
+ * Vector only needs + and scalar *, so the same code advances a single particle or a SIMD block.
+ */
+template<const auto &tableau, typename Vector, typename Scalar, typename Derivative>
+static Vector rk_step(const Vector &x, Scalar h, Derivative &&f)
+{
+    constexpr std::size_t S = std::remove_cvref_t<decltype(tableau)>::stages;
+    std::array<Vector, S> k;
+    [&]<std::size_t... i>(std::index_sequence<i...>) {
+        ((k[i] = f(rk_combine<tableau.a[i], i>(x, h, k))), ...);
+    }(std::make_index_sequence<S>{});
+    return rk_combine<tableau.b, S>(x, h, k);
+}
+
+
+#endif //NUMERICAL_CPP_RUNGEKUTTA_HPP
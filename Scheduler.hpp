@@ -0,0 +1,173 @@
+#ifndef NUMERICAL_CPP_SCHEDULER_HPP
+#define NUMERICAL_CPP_SCHEDULER_HPP
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+
+#define DEFAULT_CHUNK_SIZE 256
+
+/**
+ * a counter padded to its own cache line, so per-thread tallies do not false-share
+ */
+struct alignas(64) ThreadTally
+{
+    unsigned long value = 0;
+};
+
+static unsigned resolve_thread_count(unsigned n_threads)
+{
+    if (n_threads == 0)
+    {
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return n_threads;
+}
+
+/**
+ * Work-stealing execution of an index range [0, n_items) in fixed-size chunks.
+ * Every thread starts with a contiguous share of the chunks and takes them from the front
+ * of its own queue; a thread that runs dry steals from the back of another thread's queue.
+ * Particles finish after very different step counts, so a static split would leave most
+ * threads idle while the slowest one finishes.
+ */
+class WorkStealingScheduler
+{
+public:
+    typedef std::pair<std::size_t, std::size_t> Chunk;
+
+    unsigned n_threads;
+    std::size_t chunk_size;
+
+    explicit WorkStealingScheduler(unsigned n_threads = 0, std::size_t chunk_size = DEFAULT_CHUNK_SIZE)
+            : n_threads(resolve_thread_count(n_threads)), chunk_size(std::max<std::size_t>(1, chunk_size))
+    {}
+
+    /**
+     * calls work(begin, end, thread_id) for every chunk of [0, n_items) and returns once all are done.
+     * thread_id is in [0, n_threads) and can be used to index per-thread accumulators.
+     * if work throws, no further chunks are handed out and the first exception is rethrown here
+     * once every thread has stopped.
+     */
+    template<typename Function>
+    void run(std::size_t n_items, Function &&work) const
+    {
+        std::size_t n_chunks = (n_items + chunk_size - 1) / chunk_size;
+        unsigned n_workers = (unsigned) std::min<std::size_t>(n_threads, std::max<std::size_t>(1, n_chunks));
+
+        if (n_workers == 1)
+        {
+            for (std::size_t begin = 0; begin < n_items; begin += chunk_size)
+            {
+                work(begin, std::min(begin + chunk_size, n_items), 0u);
+            }
+            return;
+        }
+
+        std::vector<WorkQueue> queues(n_workers);
+        for (unsigned worker = 0; worker < n_workers; worker++)
+        {
+            std::size_t first = n_chunks * worker / n_workers;
+            std::size_t last = n_chunks * (worker + 1) / n_workers;
+            for (std::size_t chunk = first; chunk < last; chunk++)
+            {
+                queues[worker].chunks.emplace_back(chunk * chunk_size, std::min((chunk + 1) * chunk_size, n_items));
+            }
+        }
+
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        std::mutex error_mutex;
+        auto worker_loop = [&](unsigned worker) {
+            Chunk chunk;
+            while (!failed)
+            {
+                if (!queues[worker].pop_front(chunk) && !steal(queues, worker, chunk))
+                {
+                    //no new work is ever pushed, so empty queues everywhere means we are done
+                    return;
+                }
+                try
+                {
+                    work(chunk.first, chunk.second, worker);
+                }
+                catch (...)
+                {
+                    //an exception escaping a std::jthread would call std::terminate
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error)
+                    {
+                        error = std::current_exception();
+                    }
+                    failed = true;
+                }
+            }
+        };
+
+        {
+            std::vector<std::jthread> threads;
+            threads.reserve(n_workers - 1);
+            for (unsigned worker = 1; worker < n_workers; worker++)
+            {
+                threads.emplace_back(worker_loop, worker);
+            }
+            worker_loop(0);
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    struct WorkQueue
+    {
+        std::deque<Chunk> chunks;
+        std::mutex mutex;
+
+        bool pop_front(Chunk &chunk)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (chunks.empty())
+            {
+                return false;
+            }
+            chunk = chunks.front();
+            chunks.pop_front();
+            return true;
+        }
+
+        bool pop_back(Chunk &chunk)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (chunks.empty())
+            {
+                return false;
+            }
+            chunk = chunks.back();
+            chunks.pop_back();
+            return true;
+        }
+    };
+
+    static bool steal(std::vector<WorkQueue> &queues, unsigned thief, Chunk &chunk)
+    {
+        for (std::size_t offset = 1; offset < queues.size(); offset++)
+        {
+            if (queues[(thief + offset) % queues.size()].pop_back(chunk))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+
+#endif //NUMERICAL_CPP_SCHEDULER_HPP
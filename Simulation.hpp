@@ -2,12 +2,23 @@
 #define NUMERICAL_CPP_SIMULATION_HPP
 
 #include "Particle.hpp"
+#include "Ensemble.hpp"
+#include "Scheduler.hpp"
+#include "Random.hpp"
+#include "AsyncWriter.hpp"
+#include "AcceptanceMap.hpp"
+#include "Statistics.hpp"
+#include "Instrumentation.hpp"
+#include "Arena.hpp"
+#include "Checkpoint.hpp"
 #include "ProblemParameters.hpp"
 #include <vector>
 #include <iostream>
 #include <cassert>
-#include <random>
 #include <map>
+#include <chrono>
+#include <stdexcept>
+#include <array>
 
 #define PART_C_NUM_PARTICLES 1e5
 #define FIELDS_RATIO 3.09e7       //meters per second
@@ -15,149 +26,511 @@
 #define MIN_VELOCITY 3.01e7       //meters per second
 #define PROTON_MASS 1.67e-27      //kilograms
 #define PROTON_CHARGE 1.6e-19     //coulombs
+#define FINAL_VELOCITY_BINS 64    //over the whole reachable range, see PassedStatistics
 
 
-static long double random_double(long double &min, long double &max)
+//quantity the final velocity histogram is taken of
+static long double final_velocity_measure(long double vz)
 {
-    std::random_device rd;
-    std::default_random_engine eng(rd());
-    std::uniform_real_distribution<long double> distr(min, max);
-    return distr(eng);
+    return (MAX_VELOCITY - FIELDS_RATIO) / vz;
 }
 
-static long double get_max(const std::vector<long double> &arr)
+/**
+ * streaming statistics of the final velocity measure of passed particles.
+ * filled per thread while particles finish and merged afterwards; no particle is stored.
+ * in uniform fields vz - E/B rotates at constant magnitude, so a particle that starts with vz in
+ * [MIN_VELOCITY, MAX_VELOCITY] (symmetric around FIELDS_RATIO) ends in that range too: the histogram
+ * covers the measure over it, and anything outside (field maps, integration error) goes to the
+ * under- and overflow counts.
+ */
+struct alignas(64) PassedStatistics
 {
-    long double max = arr[0];
-    for (const auto &elem: arr)
-    {
-        if (elem > max)
-        {
-            max = elem;
-        }
-    }
-    return max;
-}
+    Moments moments;
+    QuantileSketch quantiles;
+    FixedHistogram histogram{final_velocity_measure(MAX_VELOCITY), final_velocity_measure(MIN_VELOCITY),
+                             FINAL_VELOCITY_BINS};
 
-static long double get_min(const std::vector<long double> &arr)
-{
-    long double max = arr[0];
-    for (const auto &elem: arr)
+    void add(const Particle &particle)
     {
-        if (elem < max)
+        if (particle.passed)
         {
-            max = elem;
+            auto x = final_velocity_measure(particle.state.v.z());
+            moments.add(x);
+            quantiles.add((double) x);
+            histogram.add(x);
         }
     }
-    return max;
-}
 
-static std::vector<long double> normalize(std::vector<long double> arr){
-    auto min = get_min(arr);
-    std::vector<long double> ret;
-    for(auto elem : arr){
-        ret.emplace_back((elem - min));
+    void merge(const PassedStatistics &other)
+    {
+        moments.merge(other.moments);
+        quantiles.merge(other.quantiles);
+        histogram.merge(other.histogram);
     }
-    return ret;
-}
+};
 
-static std::map<double, int> get_histogram(std::vector<long double> data, const long double bin_width)
+/**
+ * y0 in [-R, R) and vz0 in [MIN_VELOCITY, MAX_VELOCITY) of particles first..first+n-1,
+ * drawn as selected by params.sampling from the (seed, run id) stream
+ */
+static void fill_initial_conditions(const ProblemParameters &params, std::uint64_t seed, std::uint32_t run_id,
+                                    double *y0, double *vz0, std::uint64_t first, std::size_t n)
 {
-    std::sort(data.begin(), data.end());
-
-    std::map<double, int> histogram;
-
-    double bin = 0; //Choose your starting bin
-    for (const auto &e: data)
+    if (params.sampling == SOBOL)
     {
-        e >= bin + bin_width ? bin += bin_width : false;
-        ++histogram[bin];
+        ScrambledSobol sobol(seed, run_id);
+        sobol.fill_uniform(y0, first, n, 0, (double) (-1 * params.R), (double) params.R);
+        sobol.fill_uniform(vz0, first, n, 1, MIN_VELOCITY, MAX_VELOCITY);
+    }
+    else
+    {
+        CounterRng rng(seed, run_id);
+        rng.fill_uniform(y0, vz0, first, n, (double) (-1 * params.R), (double) params.R, MIN_VELOCITY, MAX_VELOCITY);
     }
-
-    return histogram;
 }
 
 class Simulation
 {
 public:
-    std::vector<Particle> particles;
+    std::pmr::memory_resource *memory;    //particles, histories and ensemble columns of this run
+    std::pmr::vector<Particle> particles;
     ProblemParameters *params;
     unsigned long crash_counter;
-
-    Simulation(int n_particles, ProblemParameters *params, bool random = false) : params(params), crash_counter(0)
+    unsigned n_threads = 1;   //0 means one thread per core
+    std::size_t chunk_size = DEFAULT_CHUNK_SIZE;
+    CounterRng rng;
+    AsyncWriter *writer = nullptr;  //if set, run() streams every finished trajectory to it
+    std::string export_tag;         //part of the trajectory filenames, see export_to_excel
+    PassedStatistics passed_statistics;
+    std::string checkpoint_file;    //if set, run() checkpoints to it, see run_checkpointed
+    double checkpoint_seconds = DEFAULT_CHECKPOINT_SECONDS;
+    unsigned long slice_steps = DEFAULT_SLICE_STEPS;
+
+    /**
+     * all storage of the run comes from `memory`; pass an Arena to release it in one go afterwards
+     * (the Simulation must be gone before the arena is reset)
+     */
+    Simulation(int n_particles, ProblemParameters *params, bool random = false, std::uint64_t seed = DEFAULT_SEED,
+               std::uint32_t run_id = 0, std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+            : memory(memory), particles(memory), params(params), crash_counter(0), rng(seed, run_id)
     {
+        INSTRUMENT_PHASE(SETUP);
+        particles.reserve(n_particles);
         //initialize particles
-        for (int i = 0; i < n_particles; i++)
+        if (random)
         {
-            State initial_condition;
-            if (random)
+            //draw whole columns of initial conditions at once
+            Ensemble::Column y0(n_particles, AlignedAllocator<double>(memory)), vz0(n_particles,
+                                                                                   AlignedAllocator<double>(memory));
+            fill_initial_conditions(*params, seed, run_id, y0.data(), vz0.data(), 0, n_particles);
+            for (int i = 0; i < n_particles; i++)
             {
-                //select random initial condition
-                long double v_min = MIN_VELOCITY;
-                long double v_max = MAX_VELOCITY;
-                long double r_min = -1 * params->R;
-                long double r_max = params->R;
-                initial_condition = {{random_double(r_min, r_max), 0},
-                                     {0,                           random_double(v_min, v_max)}};
+                particles.emplace_back(State{{y0[i], 0},
+                                             {0,     vz0[i]}}, params, memory);
             }
-            else
+        }
+        else
+        {
+            for (int i = 0; i < n_particles; i++)
             {
-                initial_condition = {{0, 0},
-                                     {0, 3 * (params->E / params->B)}};
+                particles.emplace_back(State{{0, 0},
+                                             {0, 3 * (params->E / params->B)}}, params, memory);
             }
-            particles.emplace_back(Particle(initial_condition, params));
         }
     }
 
+    /**
+     * random initial condition of particle i, identical to the one drawn by the constructor.
+     * depends only on (seed, run id, i), so it can be evaluated from any thread.
+     */
+    State random_initial_condition(std::uint64_t i) const
+    {
+        double y0, vz0;
+        fill_initial_conditions(*params, rng.seed, rng.run_id, &y0, &vz0, i, 1);
+        return {{y0, 0},
+                {0,  vz0}};
+    }
+
+    /**
+     * particles are independent, so they are spread over n_threads with a work-stealing
+     * scheduler; every thread keeps its own crash tally and the tallies are summed at the end.
+     * the outcome is identical to a serial run for any thread count.
+     * with a writer attached, each trajectory is handed to it as soon as its particle finishes and
+     * its samples are released, so the export overlaps the integration of the remaining particles.
+     */
     void run(char stage)
     {
-        if (stage == 'b')
+        if (!checkpoint_file.empty())
         {
-            for (auto &particle: particles)
+            run_checkpointed(stage);
+            return;
+        }
+
+        WorkStealingScheduler scheduler(n_threads, chunk_size);
+        check_memory(scheduler.n_threads);
+        std::vector<ThreadTally> crashes(scheduler.n_threads);
+        std::vector<PassedStatistics> statistics(scheduler.n_threads);
+        auto info = run_info();
+        scheduler.run(particles.size(), [&](std::size_t begin, std::size_t end, unsigned thread_id) {
+            INSTRUMENT_PHASE(STEPPING);
+            for (std::size_t i = begin; i < end; i++)
             {
-                for (Time t = params->dt; t < params->T; t += params->dt)
+                crashes[thread_id].value += particles[i].run(stage);
+                statistics[thread_id].add(particles[i]);
+                if (writer)
                 {
-                    //advance particle
-                    particle.advance(t);
+                    writer->submit({trajectory_filename(i), particles[i].trajectory_table(), info});
+                    particles[i].history.release();
                 }
             }
+        });
+
+        for (const auto &tally: crashes)
+        {
+            crash_counter += tally.value;
         }
-        else if (stage == 'c')
+        for (const auto &thread_statistics: statistics)
         {
-            for (auto &particle: particles)
+            passed_statistics.merge(thread_statistics);
+        }
+    }
+
+    /**
+     * run() in rounds, with a checkpoint of the whole run to checkpoint_file whenever
+     * checkpoint_seconds have passed. in every round each unfinished particle takes up to
+     * slice_steps steps; once the checkpoint is due, threads take no new chunks, the image is
+     * copied out and written on a background thread while the next round already runs.
+     * the checkpoint is deleted once the run has finished.
+     * the passed statistics are gathered at the end in particle order, so a run that was resumed
+     * (see resume) ends with exactly the same results as one that was not.
+     */
+    void run_checkpointed(char stage)
+    {
+        CheckpointWriter checkpoints(checkpoint_file);
+        WorkStealingScheduler scheduler(n_threads, chunk_size);
+        check_memory(scheduler.n_threads);
+        auto info = run_info();
+        auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(checkpoint_seconds));
+        auto deadline = std::chrono::steady_clock::now() + interval;
+        std::vector<std::size_t> pending;
+        while (true)
+        {
+            pending.clear();
+            for (std::size_t i = 0; i < particles.size(); i++)
             {
-                Time t = params->dt;
-                while (true)
+                if (!particles[i].done)
                 {
-                    //advance particle
-                    particle.advance(t);
-
-                    //check if particle crashed into the filter
-                    if (particle.crashed)
-                    {
-                        crash_counter++;
-                        break;
-                    }
+                    pending.push_back(i);
+                }
+            }
+            if (pending.empty())
+            {
+                break;
+            }
 
-                    //check if particle passed the filter
-                    if (particle.passed)
+            std::vector<ThreadTally> crashes(scheduler.n_threads);
+            scheduler.run(pending.size(), [&](std::size_t begin, std::size_t end, unsigned thread_id) {
+                //the first chunk always runs, so every round makes progress
+                if (begin > 0 && std::chrono::steady_clock::now() >= deadline)
+                {
+                    return;
+                }
+                INSTRUMENT_PHASE(STEPPING);
+                for (std::size_t k = begin; k < end; k++)
+                {
+                    auto i = pending[k];
+                    particles[i].run(stage, slice_steps);
+                    if (particles[i].done)
                     {
-                        break;
+                        crashes[thread_id].value += particles[i].crashed;
+                        if (writer)
+                        {
+                            writer->submit({trajectory_filename(i), particles[i].trajectory_table(), info});
+                            particles[i].history.release();
+                        }
                     }
+                }
+            });
+            for (const auto &tally: crashes)
+            {
+                crash_counter += tally.value;
+            }
 
-                    t += params->dt;
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                //a checkpoint must not mark particles done whose trajectories are still queued
+                if (writer)
+                {
+                    writer->flush();
                 }
+                checkpoints.write(checkpoint(stage));
+                deadline = std::chrono::steady_clock::now() + interval;
             }
         }
+        //a finished run leaves no image behind, but only once its trajectories are all on disk
+        if (writer)
+        {
+            writer->flush();
+        }
+        checkpoints.remove();
+
+        for (const auto &particle: particles)
+        {
+            passed_statistics.add(particle);
+        }
+    }
+
+    /**
+     * byte image of the run: what identifies it (particle count, seed, run id, stage and the
+     * parameters the trajectories depend on), crash_counter and every particle. the random streams
+     * are counter-based, so seed and run id are their whole state.
+     */
+    std::vector<char> checkpoint(char stage) const
+    {
+        //reserved up front: about 300 bytes per particle plus 80 per stored sample
+        std::size_t n_samples = 0;
+        for (const auto &particle: particles)
+        {
+            n_samples += particle.history.samples.size();
+        }
+        ByteWriter out;
+        out.bytes.reserve(128 + particles.size() * 320 + n_samples * 80);
+        out.put(CHECKPOINT_MAGIC);
+        out.put<std::uint32_t>(CHECKPOINT_VERSION);
+        out.put<std::uint64_t>(particles.size());
+        out.put<std::uint64_t>(rng.seed);
+        out.put<std::uint32_t>(rng.run_id);
+        write_identity(out, stage);
+        out.put<std::uint64_t>(crash_counter);
+        for (const auto &particle: particles)
+        {
+            particle.save(out);
+        }
+        return std::move(out.bytes);
     }
 
-    void export_to_excel()
+    /**
+     * restores the state of a checkpoint written by this same run, i.e. by a Simulation with the
+     * same particle count, seed, run id and parameters running the same stage; run(stage) then
+     * carries on from there.
+     */
+    void resume(const std::string &filename, char stage)
     {
+        auto bytes = read_checkpoint(filename);
+        ByteReader in(bytes);
+        auto magic = in.get<std::array<char, sizeof(CHECKPOINT_MAGIC)>>();
+        if (std::memcmp(magic.data(), CHECKPOINT_MAGIC, magic.size()) != 0 || in.get<std::uint32_t>() != CHECKPOINT_VERSION)
+        {
+            throw std::runtime_error(filename + " is not a checkpoint of this version");
+        }
+        bool same = in.get<std::uint64_t>() == particles.size();
+        same = in.get<std::uint64_t>() == rng.seed && same;
+        same = in.get<std::uint32_t>() == rng.run_id && same;
+        same = read_identity(in, stage) && same;
+        if (!same)
+        {
+            throw std::runtime_error(filename + " belongs to a different run");
+        }
+        crash_counter = in.get<std::uint64_t>();
         for (auto &particle: particles)
         {
-            particle.export_history_to_excel();
+            particle.restore(in);
         }
     }
 
+    /**
+     * stage c without integrating: every particle is classified by a precomputed acceptance map
+     * built for the same fields and geometry. the particles keep their initial states.
+     */
+    void run_map(const AcceptanceMap &map)
+    {
+        for (auto &particle: particles)
+        {
+            const auto &initial = particle.history.front().state;
+            particle.passed = map.passes(initial.r.y(), initial.v.z());
+            particle.crashed = !particle.passed;
+            crash_counter += particle.crashed;
+            INSTRUMENT_FINISHED(0, particle.crashed, particle.passed);
+        }
+    }
+
+    /**
+     * same as run(), but steps all particles through the SIMD structure-of-arrays engine
+     * in the arithmetic selected by params->precision.
+     * only the final state of every particle is recorded in its history.
+     */
+    void run_ensemble(char stage)
+    {
+        switch (params->precision)
+        {
+            case FLOAT:
+                run_ensemble_as<float>(stage);
+                break;
+            case DOUBLE:
+                run_ensemble_as<double>(stage);
+                break;
+            case LONG_DOUBLE:
+                run_ensemble_as<long double>(stage);
+                break;
+            case DOUBLE_DOUBLE:
+                run_ensemble_as<DoubleDouble>(stage);
+                break;
+        }
+    }
+
+    template<typename Real>
+    void run_ensemble_as(char stage)
+    {
+        BasicEnsemble<Real> ensemble(particles.size(), params, memory);
+        for (std::size_t i = 0; i < particles.size(); i++)
+        {
+            ensemble.set(i, particles[i].state);
+        }
+
+        {
+            INSTRUMENT_PHASE(STEPPING);
+            ensemble.run(stage, n_threads);
+        }
+
+        for (std::size_t i = 0; i < particles.size(); i++)
+        {
+            particles[i].crashed = ensemble.crashed[i];
+            particles[i].passed = ensemble.passed[i];
+            INSTRUMENT_FINISHED((unsigned long) std::ceil((double) ensemble.t[i] / (double) params->dt),
+                                particles[i].crashed, particles[i].passed);
+            particles[i].update((Time) ensemble.t[i], ensemble.get(i));
+            passed_statistics.add(particles[i]);
+        }
+        crash_counter += ensemble.crash_counter;
+    }
+
+    /**
+     * total accepted and rejected steps of an adaptive method over all particles
+     */
+    std::pair<unsigned long, unsigned long> adaptive_step_counts() const
+    {
+        std::pair<unsigned long, unsigned long> counts{0, 0};
+        for (const auto &particle: particles)
+        {
+            counts.first += particle.accepted;
+            counts.second += particle.rejected;
+        }
+        return counts;
+    }
+
+    /**
+     * what a checkpoint must agree on besides particle count, seed and run id: the stage and every
+     * parameter the trajectories depend on, the field map by its fingerprint
+     */
+    std::array<long double, 10> physics() const
+    {
+        return {params->E, params->B, params->m, params->q, params->dt, params->T, params->R, params->L, params->atol,
+                params->rtol};
+    }
+
+    void write_identity(ByteWriter &out, char stage) const
+    {
+        out.put(stage);
+        out.put<std::uint32_t>(params->method);
+        out.put<std::uint32_t>(params->record);
+        out.put<std::uint64_t>(params->record_stride);
+        out.put<std::uint8_t>(params->locate_events);
+        for (auto value: physics())
+        {
+            out.put(value);
+        }
+        out.put<std::uint8_t>(params->fields != nullptr);
+        out.put<std::uint64_t>(params->fields ? params->fields->fingerprint() : 0);
+    }
+
+    //compared value by value: the padding bytes of a stored long double are arbitrary
+    bool read_identity(ByteReader &in, char stage) const
+    {
+        bool same = in.get<char>() == stage;
+        same = in.get<std::uint32_t>() == (std::uint32_t) params->method && same;
+        same = in.get<std::uint32_t>() == (std::uint32_t) params->record && same;
+        same = in.get<std::uint64_t>() == params->record_stride && same;
+        same = in.get<std::uint8_t>() == params->locate_events && same;
+        for (auto value: physics())
+        {
+            same = in.get<long double>() == value && same;
+        }
+        same = in.get<std::uint8_t>() == (params->fields != nullptr) && same;
+        same = in.get<std::uint64_t>() == (params->fields ? params->fields->fingerprint() : 0) && same;
+        return same;
+    }
+
+    RunInfo run_info() const
+    {
+        return {*params, rng.seed, rng.run_id};
+    }
+
+    /**
+     * histories that record more than the final state grow, i.e. allocate from `memory`, on the
+     * worker threads; refuses a resource that is not thread-safe, such as a bare Arena, in that case
+     */
+    void check_memory(unsigned threads) const
+    {
+        if (threads > 1 && params->record != FINAL_ONLY && !is_thread_safe(memory))
+        {
+            throw std::logic_error("recording histories on " + std::to_string(threads) +
+                                   " threads needs a thread-safe memory resource: run one thread, record "
+                                   "FINAL_ONLY or put a std::pmr::synchronized_pool_resource on the arena");
+        }
+    }
+
+    /**
+     * CSV name of trajectory i: the method, export_tag and, for more than one particle, the index,
+     * so the files of different particles and different runs don't overwrite each other
+     */
+    std::string trajectory_filename(std::size_t i) const
+    {
+        return particles[i].excel_filename(particles.size() > 1 ? export_tag + " " + std::to_string(i) : export_tag);
+    }
+
+    void export_to_excel() const
+    {
+        for (std::size_t i = 0; i < particles.size(); i++)
+        {
+            write_csv(trajectory_filename(i), particles[i].trajectory_table());
+        }
+    }
+
+    /**
+     * all trajectories as <prefix><index><extension>, extension ".npy", ".csv" or the binary column format
+     */
+    void export_trajectories(const std::string &prefix, const std::string &extension = ".wfc") const
+    {
+        auto info = run_info();
+        for (std::size_t i = 0; i < particles.size(); i++)
+        {
+            particles[i].export_history(prefix + std::to_string(i) + extension, info);
+        }
+    }
+
+    /**
+     * one row per particle: initial y and vz, final time and state, outcome
+     */
+    ColumnTable final_state_table() const
+    {
+        ColumnTable table({"y0", "vz0", "t", "y", "z", "vy", "vz", "crashed", "passed"});
+        table.reserve(particles.size());
+        for (const auto &particle: particles)
+        {
+            const auto &initial = particle.history.front().state;
+            table.add_row({(double) initial.r.y(), (double) initial.v.z(), (double) particle.time,
+                           (double) particle.state.r.y(), (double) particle.state.r.z(), (double) particle.state.v.y(),
+                           (double) particle.state.v.z(), (double) particle.crashed, (double) particle.passed});
+        }
+        return table;
+    }
+
+    void export_final_states(const std::string &filename) const
+    {
+        write_table(filename, final_state_table(), run_info());
+    }
+
     void print_initial_conditions(bool only_passed = false)
     {
         std::ostringstream oss;
@@ -173,8 +546,9 @@ public:
             if (only_passed) condition = particle.passed;
             if (condition)
             {
-                auto y = ((particle.history.begin()->second.r.y()) / params->R);
-                auto x = ((MAX_VELOCITY - FIELDS_RATIO) / (particle.history.begin()->second.v.z()));
+                auto initial_state = particle.history.front().state;
+                auto y = ((initial_state.r.y()) / params->R);
+                auto x = ((MAX_VELOCITY - FIELDS_RATIO) / (initial_state.v.z()));
                 output_csv << x << "," << y << "\n";
             }
         }
@@ -207,43 +581,56 @@ public:
 
     long double print_passing_percentage() const
     {
-        long double pass_percent = (1 - ((long double) crash_counter / PART_C_NUM_PARTICLES)) * 100;
+        long double pass_percent = (1 - ((long double) crash_counter / particles.size())) * 100;
         return pass_percent;
     }
 
-    void print_final_velocity_histogram()
+    /**
+     * histogram of the final velocity measure of the passed particles, as collected during the runs.
+     * the bins cover the measure over [MIN_VELOCITY, MAX_VELOCITY]; values outside it get an
+     * open-ended first or last row when there are any.
+     */
+    void print_final_velocity_histogram() const
     {
-        std::ostringstream oss;
-        oss << "final_velocity_histogram.csv";
-        std::string filename = oss.str();
-
         std::ofstream output_csv;
-        output_csv.open(filename);
+        output_csv.open("final_velocity_histogram.csv");
         output_csv << "from,to,num\n";
 
-        std::vector<long double> arr;
-        for (auto &particle: particles)
+        const auto &histogram = passed_statistics.histogram;
+        if (histogram.underflow)
         {
-            if (particle.passed)
-            {
-                auto final_velocity = (--particle.history.end())->second.v.z();
-                arr.emplace_back((MAX_VELOCITY - FIELDS_RATIO) / final_velocity);
-            }
+            output_csv << "-inf," << histogram.lo << "," << histogram.underflow << "\n";
         }
-//        for(auto elem:arr){
-//            std::cout << elem << "\n";
-//        }
-        arr = normalize(arr);
-
-        const int n_bins = 20;
-        long double bin_width = get_max(arr) / n_bins;
-        auto histogram = get_histogram(arr, bin_width);
-        for (const auto& x : histogram)
+        for (std::size_t bin = 0; bin < histogram.bins.size(); bin++)
         {
-            output_csv << x.first << "," << x.first + bin_width << "," << x.second << "\n";
+            auto from = histogram.lo + bin * histogram.bin_width();
+            output_csv << from << "," << from + histogram.bin_width() << "," << histogram.bins[bin] << "\n";
         }
+        if (histogram.overflow)
+        {
+            output_csv << histogram.hi << ",inf," << histogram.overflow << "\n";
+        }
+    }
 
-        output_csv.close();
+    /**
+     * moments and quantiles of the final velocity measure of the passed particles, as collected during the runs
+     */
+    void print_final_velocity_summary() const
+    {
+        CsvWriter csv("final_velocity_summary.csv");
+        const auto &moments = passed_statistics.moments;
+        const auto &sketch = passed_statistics.quantiles;
+        csv.line({"count", "mean", "std", "min", "max", "p01", "p10", "p50", "p90", "p99"});
+        csv.field(moments.count);
+        csv.field((double) moments.mean);
+        csv.field((double) std::sqrt(moments.variance()));
+        csv.field((double) moments.min);
+        csv.field((double) moments.max);
+        for (double q: {0.01, 0.1, 0.5, 0.9})
+        {
+            csv.field(sketch.quantile(q));
+        }
+        csv.field(sketch.quantile(0.99), true);
     }
 
 };
@@ -0,0 +1,199 @@
+#ifndef NUMERICAL_CPP_STATE_HPP
+#define NUMERICAL_CPP_STATE_HPP
+
+#include <utility>
+#include <iostream>
+#include <array>
+#include <cstddef>
+#include <cmath>
+#include <type_traits>
+
+typedef long double Time;
+
+/**
+ * A vector in the (y, z) plane with value semantics: every operator returns a new vector and
+ * leaves its operands alone, only the compound assignments modify their left side.
+ * Trivially copyable and constexpr throughout; T is a scalar, or a SIMD register holding one
+ * coordinate of many particles. Aligned to two elements, so a pair of doubles is one SSE load.
+ */
+template<typename T>
+class alignas(2 * alignof(T)) BasicVector2
+{
+public:
+    T components[2];
+
+    constexpr BasicVector2() : components{T(0), T(0)}
+    {}
+
+    constexpr BasicVector2(T y, T z) : components{y, z}
+    {}
+
+    constexpr T &y()
+    {
+        return components[0];
+    }
+
+    constexpr T &z()
+    {
+        return components[1];
+    }
+
+    constexpr const T &y() const
+    {
+        return components[0];
+    }
+
+    constexpr const T &z() const
+    {
+        return components[1];
+    }
+
+    constexpr BasicVector2 &operator+=(const BasicVector2 &other)
+    {
+        components[0] += other.components[0];
+        components[1] += other.components[1];
+        return *this;
+    }
+
+    constexpr BasicVector2 &operator-=(const BasicVector2 &other)
+    {
+        components[0] -= other.components[0];
+        components[1] -= other.components[1];
+        return *this;
+    }
+
+    constexpr BasicVector2 &operator*=(const T &n)
+    {
+        components[0] *= n;
+        components[1] *= n;
+        return *this;
+    }
+
+    constexpr BasicVector2 &operator/=(const T &n)
+    {
+        components[0] /= n;
+        components[1] /= n;
+        return *this;
+    }
+
+    friend constexpr BasicVector2 operator+(BasicVector2 lhs, const BasicVector2 &rhs)
+    {
+        return lhs += rhs;
+    }
+
+    friend constexpr BasicVector2 operator-(BasicVector2 lhs, const BasicVector2 &rhs)
+    {
+        return lhs -= rhs;
+    }
+
+    friend constexpr BasicVector2 operator-(const BasicVector2 &v)
+    {
+        return {-v.components[0], -v.components[1]};
+    }
+
+    friend constexpr BasicVector2 operator*(BasicVector2 v, const T &n)
+    {
+        return v *= n;
+    }
+
+    friend constexpr BasicVector2 operator*(const T &n, BasicVector2 v)
+    {
+        return v *= n;
+    }
+
+    friend constexpr BasicVector2 operator/(BasicVector2 v, const T &n)
+    {
+        return v /= n;
+    }
+
+    friend constexpr bool operator==(const BasicVector2 &a, const BasicVector2 &b)
+    {
+        return a.components[0] == b.components[0] && a.components[1] == b.components[1];
+    }
+
+    friend constexpr T dot(const BasicVector2 &a, const BasicVector2 &b)
+    {
+        return a.components[0] * b.components[0] + a.components[1] * b.components[1];
+    }
+
+    T norm() const
+    {
+        using std::sqrt;
+        return sqrt(dot(*this, *this));
+    }
+};
+
+typedef BasicVector2<long double> Vector2;
+
+static_assert(std::is_trivially_copyable_v<Vector2>, "vectors are copied around by value");
+
+class State
+{
+public:
+    Vector2 r;
+    Vector2 v;
+
+    friend std::ostream &operator<<(std::ostream &os, const State &s)
+    {
+        os << "(y,z) = (" << s.r.y() << "," << s.r.z() << ")\n";
+        os << "(Vy,Vz) = (" << s.v.y() << "," << s.v.z() << ")\n";
+        return os;
+    }
+};
+
+
+/**
+ * (y, z, vy, vz) as one flat vector, for integrators that treat the whole state at once.
+ * T is a scalar for a single particle or a SIMD register holding one coordinate of many particles.
+ */
+template<typename T>
+class PhaseVector
+{
+public:
+    std::array<T, 4> x;
+
+    T &operator[](std::size_t i)
+    {
+        return x[i];
+    }
+
+    const T &operator[](std::size_t i) const
+    {
+        return x[i];
+    }
+
+    friend PhaseVector operator+(PhaseVector lhs, const PhaseVector &rhs)
+    {
+        for (std::size_t i = 0; i < 4; i++)
+        {
+            lhs.x[i] += rhs.x[i];
+        }
+        return lhs;
+    }
+
+    template<typename S>
+    friend PhaseVector operator*(const S &n, PhaseVector rhs)
+    {
+        for (std::size_t i = 0; i < 4; i++)
+        {
+            rhs.x[i] = n * rhs.x[i];
+        }
+        return rhs;
+    }
+};
+
+typedef PhaseVector<long double> StateVector;
+
+static StateVector to_vector(State s)
+{
+    return {s.r.y(), s.r.z(), s.v.y(), s.v.z()};
+}
+
+static State to_state(const StateVector &x)
+{
+    return {{x[0], x[1]},
+            {x[2], x[3]}};
+}
+
+
+#endif //NUMERICAL_CPP_STATE_HPP
@@ -0,0 +1,230 @@
+#ifndef NUMERICAL_CPP_STATISTICS_HPP
+#define NUMERICAL_CPP_STATISTICS_HPP
+
+#include <vector>
+#include <cstddef>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <utility>
+
+#define DEFAULT_SKETCH_K 200
+
+/**
+ * count, mean, variance, min and max in one pass (Welford).
+ * merge() combines two partial results exactly (Chan et al.), so per-thread instances can be summed.
+ */
+class Moments
+{
+public:
+    unsigned long count = 0;
+    long double mean = 0;
+    long double m2 = 0;         //sum of squared deviations from the mean
+    long double min = std::numeric_limits<long double>::infinity();
+    long double max = -std::numeric_limits<long double>::infinity();
+
+    void add(long double x)
+    {
+        count++;
+        auto delta = x - mean;
+        mean += delta / count;
+        m2 += delta * (x - mean);
+        min = std::min(min, x);
+        max = std::max(max, x);
+    }
+
+    void merge(const Moments &other)
+    {
+        if (other.count == 0)
+        {
+            return;
+        }
+        auto n = count + other.count;
+        auto delta = other.mean - mean;
+        mean += delta * other.count / n;
+        m2 += other.m2 + delta * delta * ((long double) count * other.count / n);
+        count = n;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+    }
+
+    long double variance() const
+    {
+        return count > 1 ? m2 / (count - 1) : 0;
+    }
+};
+
+/**
+ * n equal bins over [lo, hi], plus under- and overflow counts. hi itself falls in the last bin.
+ * Counts only, so merging is exact and memory does not depend on the number of samples.
+ */
+class FixedHistogram
+{
+public:
+    long double lo;
+    long double hi;
+    std::vector<unsigned long> bins;
+    unsigned long underflow = 0;
+    unsigned long overflow = 0;
+
+    FixedHistogram(long double lo = 0, long double hi = 1, std::size_t n_bins = 1) : lo(lo), hi(hi),
+                                                                                      bins(std::max<std::size_t>(1, n_bins))
+    {}
+
+    void add(long double x)
+    {
+        if (x < lo)
+        {
+            underflow++;
+        }
+        else if (x > hi)
+        {
+            overflow++;
+        }
+        else
+        {
+            auto bin = hi > lo ? (std::size_t) ((x - lo) / (hi - lo) * bins.size()) : 0;
+            bins[std::min(bin, bins.size() - 1)]++;
+        }
+    }
+
+    //both histograms must have the same range and number of bins
+    void merge(const FixedHistogram &other)
+    {
+        for (std::size_t i = 0; i < bins.size(); i++)
+        {
+            bins[i] += other.bins[i];
+        }
+        underflow += other.underflow;
+        overflow += other.overflow;
+    }
+
+    long double bin_width() const
+    {
+        return (hi - lo) / bins.size();
+    }
+};
+
+/**
+ * KLL quantile sketch (Karnin, Lang, Liberty 2016). Items sit in levels of compactors, an item at
+ * level h standing for 2^h samples; a full compactor sorts itself and promotes every other item
+ * to the next level. Memory is O(k log(n / k)) and the rank error about 1.7 / k, whatever n.
+ * Sketches from different threads merge by concatenating levels and compacting again. The choice
+ * of odd or even items alternates per level instead of being random, so runs are reproducible.
+ */
+class QuantileSketch
+{
+public:
+    explicit QuantileSketch(std::size_t k = DEFAULT_SKETCH_K) : k(std::max<std::size_t>(8, k)), levels(1)
+    {}
+
+    void add(double x)
+    {
+        levels[0].push_back(x);
+        n++;
+        compress();
+    }
+
+    void merge(const QuantileSketch &other)
+    {
+        if (levels.size() < other.levels.size())
+        {
+            levels.resize(other.levels.size());
+        }
+        for (std::size_t h = 0; h < other.levels.size(); h++)
+        {
+            levels[h].insert(levels[h].end(), other.levels[h].begin(), other.levels[h].end());
+        }
+        n += other.n;
+        compress();
+    }
+
+    unsigned long count() const
+    {
+        return n;
+    }
+
+    /**
+     * approximate q-quantile, q in [0, 1]; NaN for an empty sketch
+     */
+    double quantile(double q) const
+    {
+        auto items = weighted_items();
+        if (items.empty())
+        {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        unsigned long total = 0;
+        for (const auto &item: items)
+        {
+            total += item.second;
+        }
+        auto target = q * total;
+        unsigned long cumulative = 0;
+        for (const auto &item: items)
+        {
+            cumulative += item.second;
+            if (cumulative >= target)
+            {
+                return item.first;
+            }
+        }
+        return items.back().first;
+    }
+
+private:
+    std::size_t k;
+    std::vector<std::vector<double>> levels;
+    unsigned long n = 0;
+    std::vector<unsigned char> odd;     //per level, which item of each pair is promoted next
+
+    std::size_t capacity(std::size_t h) const
+    {
+        //levels shrink by 2/3 going down from the top one
+        auto depth = levels.size() - 1 - h;
+        return std::max<std::size_t>(2, (std::size_t) (k * std::pow(2.0 / 3.0, (double) depth)));
+    }
+
+    void compress()
+    {
+        for (std::size_t h = 0; h < levels.size(); h++)
+        {
+            if (levels[h].size() < capacity(h))
+            {
+                continue;
+            }
+            if (h + 1 == levels.size())
+            {
+                levels.emplace_back();
+            }
+            odd.resize(levels.size());
+            auto &level = levels[h];
+            std::sort(level.begin(), level.end());
+            //with an odd count the smallest item stays behind, so the total weight is preserved
+            std::size_t first = level.size() % 2;
+            for (std::size_t i = first + odd[h]; i < level.size(); i += 2)
+            {
+                levels[h + 1].push_back(level[i]);
+            }
+            odd[h] = !odd[h];
+            level.resize(first);
+        }
+    }
+
+    std::vector<std::pair<double, unsigned long>> weighted_items() const
+    {
+        std::vector<std::pair<double, unsigned long>> items;
+        for (std::size_t h = 0; h < levels.size(); h++)
+        {
+            for (auto x: levels[h])
+            {
+                items.emplace_back(x, 1ul << h);
+            }
+        }
+        std::sort(items.begin(), items.end());
+        return items;
+    }
+};
+
+
+#endif //NUMERICAL_CPP_STATISTICS_HPP
@@ -0,0 +1,259 @@
+#ifndef NUMERICAL_CPP_SWEEP_HPP
+#define NUMERICAL_CPP_SWEEP_HPP
+
+#include "Simulation.hpp"
+#include "Ensemble.hpp"
+#include "Scheduler.hpp"
+#include "Random.hpp"
+#include "Output.hpp"
+#include "Statistics.hpp"
+#include <vector>
+#include <string>
+#include <functional>
+#include <chrono>
+#include <algorithm>
+
+#define SWEEP_HISTOGRAM_BINS 20
+
+/**
+ * one swept quantity: a name for the result table, its values and how to apply a value
+ */
+class SweepAxis
+{
+public:
+    std::string name;
+    std::vector<long double> values;
+    std::function<void(ProblemParameters &, long double)> apply;
+
+    static SweepAxis field(const std::string &name, long double ProblemParameters::*member,
+                           std::vector<long double> values)
+    {
+        return {name, std::move(values), [member](ProblemParameters &p, long double value) { p.*member = value; }};
+    }
+
+    static SweepAxis methods(const std::vector<METHOD> &methods)
+    {
+        std::vector<long double> values(methods.begin(), methods.end());
+        return {"method", values, [](ProblemParameters &p, long double value) { p.method = (METHOD) value; }};
+    }
+};
+
+class SweepPoint
+{
+public:
+    ProblemParameters params;
+    std::vector<long double> coordinates;   //value of every axis at this point
+};
+
+/**
+ * cartesian product of the axes around `base`, the last axis varies fastest.
+ * w and T are recomputed at every point, since they follow from B, m and q.
+ */
+static std::vector<SweepPoint> parameter_grid(const ProblemParameters &base, const std::vector<SweepAxis> &axes)
+{
+    std::vector<SweepPoint> points{{base, {}}};
+    for (const auto &axis: axes)
+    {
+        std::vector<SweepPoint> next;
+        next.reserve(points.size() * axis.values.size());
+        for (const auto &point: points)
+        {
+            for (auto value: axis.values)
+            {
+                SweepPoint extended = point;
+                axis.apply(extended.params, value);
+                extended.coordinates.push_back(value);
+                next.push_back(std::move(extended));
+            }
+        }
+        points = std::move(next);
+    }
+    for (auto &point: points)
+    {
+        point.params.w = point.params.q * point.params.B / point.params.m;
+        point.params.T = NUM_PERIODS * 2 * M_PI / point.params.w;
+    }
+    return points;
+}
+
+class SweepResult
+{
+public:
+    std::size_t particles = 0;
+    unsigned long passed = 0;
+    unsigned long crashed = 0;
+    double compute_seconds = 0;     //thread time spent on this point, summed over threads
+    long double vz_min = 0;         //range of the final vz of the passed particles
+    long double vz_max = 0;
+    long double histogram_min = 0;  //range the bins of the histogram cover
+    long double histogram_max = 0;
+    std::vector<unsigned long> histogram;
+
+    long double pass_percentage() const
+    {
+        return particles ? 100.0L * passed / particles : 0;
+    }
+};
+
+/**
+ * Runs the stage-c experiment at every point of a parameter grid.
+ * The points are processed in waves of wave_size; all (point, SIMD block) work items of a wave go
+ * to one work-stealing scheduler, so small and slow points share the cores instead of running
+ * one after the other. Every point of a wave owns one ensemble of a pool that is reset, not
+ * reallocated, for the next wave. Every point draws its initial conditions from the same
+ * (seed, run id) stream, so differences between points are not sampling noise.
+ */
+class ParameterSweep
+{
+public:
+    std::vector<SweepAxis> axes;
+    std::vector<SweepPoint> points;
+    std::size_t n_particles;
+    std::uint64_t seed = DEFAULT_SEED;
+    std::uint32_t run_id = 0;
+    unsigned n_threads = 0;         //0 means one thread per core
+    std::size_t wave_size = 0;      //points in flight at once, 0 means all of them
+    std::size_t n_bins = SWEEP_HISTOGRAM_BINS;
+    double wall_seconds = 0;
+
+    ParameterSweep(const ProblemParameters &base, std::vector<SweepAxis> axes, std::size_t n_particles)
+            : axes(std::move(axes)), points(parameter_grid(base, this->axes)), n_particles(n_particles)
+    {}
+
+    std::vector<SweepResult> run(char stage = 'c')
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<SweepResult> results(points.size());
+        std::size_t wave = wave_size ? std::min(wave_size, points.size()) : points.size();
+        std::vector<Ensemble> pool;
+        pool.reserve(wave);
+        for (std::size_t k = 0; k < wave; k++)
+        {
+            pool.emplace_back(0, nullptr);
+        }
+
+        WorkStealingScheduler scheduler(n_threads, std::max<std::size_t>(1, DEFAULT_CHUNK_SIZE / Ensemble::lanes));
+
+        for (std::size_t first = 0; first < points.size(); first += wave)
+        {
+            std::size_t count = std::min(wave, points.size() - first);
+            for (std::size_t k = 0; k < count; k++)
+            {
+                auto &ensemble = pool[k];
+                auto &params = points[first + k].params;
+                ensemble.reset(n_particles, &params);
+                fill_initial_conditions(params, seed, run_id, ensemble.y.data(), ensemble.vz.data(), 0, n_particles);
+            }
+
+            std::size_t blocks_per_point = pool[0].n_blocks();
+            std::vector<std::vector<double>> seconds(scheduler.n_threads, std::vector<double>(count));
+            scheduler.run(count * blocks_per_point, [&](std::size_t begin, std::size_t end, unsigned thread_id) {
+                //a chunk can straddle two points, so it is cut at the point boundaries
+                while (begin < end)
+                {
+                    std::size_t k = begin / blocks_per_point;
+                    std::size_t stop = std::min(end, (k + 1) * blocks_per_point);
+                    auto chunk_start = std::chrono::steady_clock::now();
+                    pool[k].run_range(stage, begin - k * blocks_per_point, stop - k * blocks_per_point);
+                    seconds[thread_id][k] += std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - chunk_start).count();
+                    begin = stop;
+                }
+            });
+
+            for (std::size_t k = 0; k < count; k++)
+            {
+                auto &result = results[first + k];
+                for (const auto &thread_seconds: seconds)
+                {
+                    result.compute_seconds += thread_seconds[k];
+                }
+                summarize(pool[k], result);
+            }
+        }
+        wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return results;
+    }
+
+    /**
+     * one row per point: the axis values, pass rate, timing and the final vz histogram of the passed particles
+     */
+    void write_table(const std::string &filename, const std::vector<SweepResult> &results) const
+    {
+        CsvWriter csv(filename);
+        std::vector<std::string> header{"point"};
+        for (const auto &axis: axes)
+        {
+            header.push_back(axis.name);
+        }
+        for (const char *name: {"method_name", "particles", "passed", "crashed", "pass_percent", "compute_seconds",
+                                "vz_min", "vz_max", "histogram_min", "histogram_max"})
+        {
+            header.emplace_back(name);
+        }
+        for (std::size_t bin = 0; bin < n_bins; bin++)
+        {
+            header.push_back("bin_" + std::to_string(bin));
+        }
+        csv.line(header);
+
+        for (std::size_t i = 0; i < results.size(); i++)
+        {
+            const auto &result = results[i];
+            csv.field(i);
+            for (auto value: points[i].coordinates)
+            {
+                csv.field((double) value);
+            }
+            csv.field(method_name(points[i].params.method));
+            csv.field(result.particles);
+            csv.field(result.passed);
+            csv.field(result.crashed);
+            csv.field((double) result.pass_percentage());
+            csv.field(result.compute_seconds);
+            csv.field((double) result.vz_min);
+            csv.field((double) result.vz_max);
+            csv.field((double) result.histogram_min);
+            csv.field((double) result.histogram_max, result.histogram.empty());
+            for (std::size_t bin = 0; bin < result.histogram.size(); bin++)
+            {
+                csv.field(result.histogram[bin], bin + 1 == result.histogram.size());
+            }
+        }
+    }
+
+private:
+    /**
+     * pass counts and the final vz histogram of one point in a single pass over its ensemble.
+     * vz - E/B keeps its magnitude in uniform fields, so the passed particles end within
+     * E/B +- max(MAX_VELOCITY - E/B, E/B - MIN_VELOCITY) and the bins are fixed before any is counted.
+     */
+    void summarize(const Ensemble &ensemble, SweepResult &result) const
+    {
+        const auto &params = *ensemble.params;
+        auto drift = params.E / params.B;
+        auto spread = std::max<long double>(MAX_VELOCITY - drift, drift - MIN_VELOCITY);
+        FixedHistogram histogram(drift - spread, drift + spread, n_bins);
+        Moments vz;
+        result.particles = ensemble.size;
+        result.crashed = 0;
+        for (std::size_t i = 0; i < ensemble.size; i++)
+        {
+            result.crashed += ensemble.crashed[i];
+            if (ensemble.passed[i])
+            {
+                vz.add(ensemble.vz[i]);
+                histogram.add(ensemble.vz[i]);
+            }
+        }
+        result.passed = vz.count;
+        result.vz_min = vz.count ? vz.min : 0;
+        result.vz_max = vz.count ? vz.max : 0;
+        result.histogram_min = histogram.lo;
+        result.histogram_max = histogram.hi;
+        result.histogram = std::move(histogram.bins);
+    }
+};
+
+
+#endif //NUMERICAL_CPP_SWEEP_HPP
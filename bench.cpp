@@ -0,0 +1,286 @@
+#include "Simulation.hpp"
+#include "Output.hpp"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define BENCH_WARMUP 1
+#define BENCH_REPEATS 5
+
+/**
+ * Self-contained benchmark harness. Every case runs BENCH_WARMUP untimed and BENCH_REPEATS timed
+ * repetitions and reports min / median / mean / standard deviation of the time per repetition
+ * together with a throughput figure. The report is JSON, on stdout or in the file given as first
+ * argument; "quick" as second argument uses smaller sizes.
+ */
+
+class Measurement
+{
+public:
+    std::string name;
+    std::vector<std::pair<std::string, std::string>> labels;
+    std::vector<double> seconds;
+    double work = 0;            //units of work per repetition
+    std::string unit;           //what the throughput counts, e.g. "steps"
+
+    double min() const
+    {
+        return *std::min_element(seconds.begin(), seconds.end());
+    }
+
+    double median() const
+    {
+        auto sorted = seconds;
+        std::sort(sorted.begin(), sorted.end());
+        auto n = sorted.size();
+        return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    }
+
+    double mean() const
+    {
+        double sum = 0;
+        for (auto s: seconds)
+        {
+            sum += s;
+        }
+        return sum / seconds.size();
+    }
+
+    double stddev() const
+    {
+        if (seconds.size() < 2)
+        {
+            return 0;
+        }
+        double m = mean(), sum = 0;
+        for (auto s: seconds)
+        {
+            sum += (s - m) * (s - m);
+        }
+        return std::sqrt(sum / (seconds.size() - 1));
+    }
+};
+
+/**
+ * times `body`, which returns the amount of work it did; setup runs untimed before every repetition
+ */
+static Measurement measure(const std::string &name, const std::string &unit,
+                           std::vector<std::pair<std::string, std::string>> labels,
+                           const std::function<void()> &setup, const std::function<double()> &body)
+{
+    Measurement result{name, std::move(labels), {}, 0, unit};
+    for (int i = 0; i < BENCH_WARMUP + BENCH_REPEATS; i++)
+    {
+        setup();
+        auto start = std::chrono::steady_clock::now();
+        auto work = body();
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (i >= BENCH_WARMUP)
+        {
+            result.seconds.push_back(seconds);
+            result.work = work;
+        }
+    }
+    std::cerr << name;
+    for (const auto &label: result.labels)
+    {
+        std::cerr << " " << label.first << "=" << label.second;
+    }
+    std::cerr << ": " << result.median() * 1e3 << " ms\n";
+    return result;
+}
+
+static std::string json(const std::vector<Measurement> &measurements)
+{
+    std::ostringstream out;
+    out.precision(9);
+    out << "{\n  \"warmup\": " << BENCH_WARMUP << ",\n  \"repeats\": " << BENCH_REPEATS
+        << ",\n  \"benchmarks\": [\n";
+    for (std::size_t i = 0; i < measurements.size(); i++)
+    {
+        const auto &m = measurements[i];
+        out << "    {\"name\": \"" << m.name << "\"";
+        for (const auto &label: m.labels)
+        {
+            out << ", \"" << label.first << "\": \"" << label.second << "\"";
+        }
+        out << ", \"min_s\": " << m.min() << ", \"median_s\": " << m.median() << ", \"mean_s\": " << m.mean()
+            << ", \"stddev_s\": " << m.stddev() << ", \"work\": " << m.work << ", \"unit\": \"" << m.unit
+            << "\", \"per_second\": " << m.work / m.median() << ", \"ns_per_unit\": "
+            << (m.work > 0 ? m.median() / m.work * 1e9 : 0) << "}" << (i + 1 < measurements.size() ? "," : "")
+            << "\n";
+    }
+    out << "  ]\n}\n";
+    return out.str();
+}
+
+static ProblemParameters stage_c_parameters(METHOD method)
+{
+    ProblemParameters params{FIELDS_RATIO, 1, PROTON_MASS, PROTON_CHARGE, 1e-9, 0.003, 1, method};
+    params.record = FINAL_ONLY;
+    params.locate_events = true;
+    return params;
+}
+
+static const char *precision_name(PRECISION precision)
+{
+    const char *names[] = {"float", "double", "long", "dd"};
+    return names[precision];
+}
+
+int main(int argc, char *argv[])
+{
+    bool quick = argc > 2 && std::string(argv[2]) == "quick";
+    std::vector<Measurement> results;
+
+    //single-particle stepping cost of every method, part B setup, final state only
+    for (auto method: {TAYLOR, MIDPOINT, RUNGE_KUTTA, ANALYTIC, DORMAND_PRINCE, BORIS, SSPRK3, RK6})
+    {
+        ProblemParameters params{};
+        params.method = method;
+        params.dt = quick ? 1e-4 : 1e-5;
+        params.record = FINAL_ONLY;
+        std::unique_ptr<Particle> particle;
+        results.push_back(measure("particle_step", "steps", {{"method", method_name(method)}}, [&] {
+            particle = std::make_unique<Particle>(State{{0, 0}, {0, 3 * (params.E / params.B)}}, &params);
+        }, [&] {
+            particle->run('b');
+            return (double) particle->history.steps;
+        }));
+    }
+
+    //cost of the field lookup: RK4 in a field map holding the uniform fields
+    for (auto interpolation: {BILINEAR, BICUBIC})
+    {
+        ProblemParameters params{};
+        params.method = RUNGE_KUTTA;
+        params.dt = quick ? 1e-4 : 1e-5;
+        params.record = FINAL_ONLY;
+        auto fields = FieldMap::sample(64, 64, -10, -10, 20.0 / 63, 20.0 / 63, [&](double, double) {
+            return FieldSample{params.E, params.B};
+        });
+        fields.interpolation = interpolation;
+        params.fields = &fields;
+        std::unique_ptr<Particle> particle;
+        results.push_back(measure("particle_step_field_map", "steps",
+                                  {{"interpolation", interpolation == BICUBIC ? "bicubic" : "bilinear"}}, [&] {
+                    particle = std::make_unique<Particle>(State{{0, 0}, {0, 3 * (params.E / params.B)}}, &params);
+                }, [&] {
+                    particle->run('b');
+                    return (double) particle->history.steps;
+                }));
+    }
+
+    std::vector<std::size_t> sizes = quick ? std::vector<std::size_t>{1000, 10000}
+                                           : std::vector<std::size_t>{1000, 10000, 100000};
+
+    for (auto n: sizes)
+    {
+        auto params = stage_c_parameters(RUNGE_KUTTA);
+        std::unique_ptr<Simulation> simulation;
+
+        //constructor: initial conditions and particle vector
+        results.push_back(measure("simulation_setup", "particles", {{"particles", std::to_string(n)}}, [] {}, [&] {
+            simulation = std::make_unique<Simulation>(n, &params, true);
+            return (double) n;
+        }));
+
+        //scalar particle loop
+        results.push_back(measure("simulation_run", "steps", {{"particles", std::to_string(n)}}, [&] {
+            simulation = std::make_unique<Simulation>(n, &params, true);
+        }, [&] {
+            simulation->run('c');
+            double steps = 0;
+            for (const auto &particle: simulation->particles)
+            {
+                steps += particle.history.steps;
+            }
+            return steps;
+        }));
+
+        //SIMD ensemble in every precision
+        for (auto precision: {FLOAT, DOUBLE, LONG_DOUBLE, DOUBLE_DOUBLE})
+        {
+            auto ensemble_params = params;
+            ensemble_params.precision = precision;
+            results.push_back(measure("simulation_run_ensemble", "steps",
+                                      {{"particles", std::to_string(n)}, {"precision", precision_name(precision)}},
+                                      [&] {
+                                          simulation = std::make_unique<Simulation>(n, &ensemble_params, true);
+                                      }, [&] {
+                        simulation->run_ensemble('c');
+                        double steps = 0;
+                        for (const auto &particle: simulation->particles)
+                        {
+                            steps += (double) (particle.time / ensemble_params.dt);
+                        }
+                        return steps;
+                    }));
+        }
+
+        //SIMD ensemble in a field map holding the uniform fields, against the uniform double run above
+        auto fields = FieldMap::sample(33, 33, (double) -params.R, 0, (double) params.R / 16,
+                                       (double) params.L / 32, [&](double, double) {
+                    return FieldSample{params.E, params.B};
+                });
+        for (auto interpolation: {BILINEAR, BICUBIC})
+        {
+            fields.interpolation = interpolation;
+            auto mapped_params = params;
+            mapped_params.fields = &fields;
+            results.push_back(measure("simulation_run_ensemble_field_map", "steps",
+                                      {{"particles", std::to_string(n)},
+                                       {"interpolation", interpolation == BICUBIC ? "bicubic" : "bilinear"}},
+                                      [&] {
+                                          simulation = std::make_unique<Simulation>(n, &mapped_params, true);
+                                      }, [&] {
+                        simulation->run_ensemble('c');
+                        double steps = 0;
+                        for (const auto &particle: simulation->particles)
+                        {
+                            steps += (double) (particle.time / mapped_params.dt);
+                        }
+                        return steps;
+                    }));
+        }
+    }
+
+    //export throughput of a long trajectory in every format
+    {
+        ProblemParameters params{};
+        params.method = RUNGE_KUTTA;
+        params.dt = quick ? 1e-4 : 1e-5;
+        params.record = FULL;
+        Particle particle({{0, 0}, {0, 3 * (params.E / params.B)}}, &params);
+        particle.run('b');
+        auto table = particle.trajectory_table();
+        RunInfo info{params, DEFAULT_SEED, 0};
+        double bytes = (double) (table.rows() * table.columns.size() * sizeof(double));
+        for (std::string extension: {".csv", ".npy", ".wfc"})
+        {
+            auto filename = "bench_export" + extension;
+            results.push_back(measure("export", "bytes", {{"format", extension.substr(1)},
+                                                          {"rows", std::to_string(table.rows())}}, [] {}, [&] {
+                write_table(filename, table, info);
+                return bytes;
+            }));
+            std::remove(filename.c_str());
+        }
+    }
+
+    auto report = json(results);
+    if (argc > 1)
+    {
+        std::ofstream(argv[1]) << report;
+    }
+    else
+    {
+        std::cout << report;
+    }
+    return 0;
+}
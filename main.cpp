@@ -1,6 +1,19 @@
 #include "Simulation.hpp"
+#include "Sweep.hpp"
+#include "ConvergenceStudy.hpp"
+#include "PassRateEstimator.hpp"
 #include <string>
 #include <set>
+#include <numeric>
+#include <sstream>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+
+#define PART_B_SAMPLES 10000
+#define QMC_REPLICATES 16
+#define QMC_PARTICLES 16384
+#define FRINGE_PARTICLES 10000
 
 bool s_equals(const std::string &a, const std::string &b)
 {
@@ -22,20 +35,59 @@ long double average(std::vector<long double> const &v)
     return std::reduce(v.begin(), v.end()) / count;
 }
 
-long double distance(DoublePair x, DoublePair y)
+long double distance(const Vector2 &x, const Vector2 &y)
 {
-    // Calculating distance
-    auto x1 = x.pair.first;
-    auto y1 = x.pair.second;
-    auto x2 = y.pair.first;
-    auto y2 = y.pair.second;
-    return sqrt(pow(x2 - x1, 2) + pow(y2 - y1, 2) * 1.0);
+    return (y - x).norm();
 }
 
 int main(int argc, char **argv)
 {
+    //flags may follow the stage anywhere: --checkpoint[=seconds] makes stages b and c checkpoint their
+    //runs, --resume also carries on from the checkpoints they left behind
+    std::vector<std::string> arguments;
+    bool checkpointing = false, resume = false;
+    double checkpoint_seconds = DEFAULT_CHECKPOINT_SECONDS;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (s_equals(arg, "--resume"))
+        {
+            checkpointing = resume = true;
+        }
+        else if (s_equals(arg, "--checkpoint") || s_equals(arg.substr(0, 13), "--checkpoint="))
+        {
+            checkpointing = true;
+            if (arg.size() > 13)
+            {
+                checkpoint_seconds = std::stod(arg.substr(13));
+            }
+        }
+        else
+        {
+            arguments.push_back(arg);
+        }
+    }
+    //optional second argument: number of threads, 0 for one per core
+    unsigned n_threads = arguments.size() > 0 ? std::stoul(arguments[0]) : 1;
+    //optional third argument: arithmetic of the ensemble runs, float / double / long / dd
+    PRECISION precision = arguments.size() > 1 ? parse_precision(arguments[1]) : DEFAULT_PRECISION;
+    auto continue_from_checkpoint = [&](Simulation &simulation, const std::string &filename, char stage) {
+        if (!checkpointing)
+        {
+            return;
+        }
+        simulation.checkpoint_file = filename;
+        simulation.checkpoint_seconds = checkpoint_seconds;
+        if (resume && std::filesystem::exists(filename))
+        {
+            simulation.resume(filename, stage);
+        }
+    };
+
     if (s_equals(argv[1], "b"))
     {
+        //trajectories are written in the background while the next dt is integrated
+        AsyncWriter writer;
         for (const auto &method: std::set{TAYLOR, MIDPOINT, RUNGE_KUTTA})
         {
             std::map<long double, long double> errors;
@@ -44,13 +96,22 @@ int main(int argc, char **argv)
                 ProblemParameters params{};
                 params.method = method;
                 params.dt = dt;
+                //keep about PART_B_SAMPLES points of each trajectory, however small dt gets
+                params.record = EVERY_K;
+                params.record_stride = std::max<std::size_t>(1, (std::size_t) (params.T / dt / PART_B_SAMPLES));
                 Simulation partB(1, &params);
+                std::ostringstream tag;
+                tag << " dt=" << dt;
+                partB.export_tag = tag.str();
+                partB.writer = &writer;
+                continue_from_checkpoint(partB, method_name(method) + tag.str() + ".ckpt", 'b');
                 partB.run('b');
-                auto final_pos = (--partB.particles[0].history.end())->second.r;
-                auto analytical_solution = DoublePair(0, 2 * M_PI);
+                auto &particle = partB.particles[0];
+                auto final_pos = particle.state.r;
+                //exact position at the time the stepping actually stopped
+                auto analytical_solution = CrossedFieldSolution(particle.history.front().state, params).at(particle.time).r;
                 std::cout << distance(final_pos, analytical_solution) << "\n";
                 errors[dt] = distance(final_pos, analytical_solution);
-                partB.export_to_excel();
             }
         }
     }
@@ -59,21 +120,37 @@ int main(int argc, char **argv)
     {
         ProblemParameters params{FIELDS_RATIO, 1, PROTON_MASS, PROTON_CHARGE, 1e-9, 0.003, 1,
                                  RUNGE_KUTTA};
-        Simulation partC(PART_C_NUM_PARTICLES, &params, true);
+        params.locate_events = true;
+        if (checkpointing)
+        {
+            //every stored sample goes into each image, a checkpointed run keeps the final states only
+            params.record = FINAL_ONLY;
+        }
+        Simulation partC(PART_C_NUM_PARTICLES, &params, true, DEFAULT_SEED, 0);
+        partC.n_threads = n_threads;
+        continue_from_checkpoint(partC, "partC.ckpt", 'c');
         partC.run('c');
         partC.print_one_passed_one_didnt();
         partC.print_initial_conditions(true);
         partC.print_final_velocity_histogram();
+        partC.print_final_velocity_summary();
+        partC.export_final_states("final_states.wfc");
         std::cout << "done\n";
 
         {
             std::vector<long double> percentages;
-            for (int i = 0; i < 53; ++i)
+            //one arena for all runs: after the first run each run's storage is a single reused block
+            Arena arena;
+            for (int i = 0; i < 53; ++i, arena.reset())
             {
                 ProblemParameters parameters{FIELDS_RATIO, 1, PROTON_MASS, PROTON_CHARGE, 1e-9, 0.003, 1,
                                              RUNGE_KUTTA};
-                Simulation sim(PART_C_NUM_PARTICLES, &parameters, true);
-                sim.run('c');
+                parameters.record = FINAL_ONLY;
+                parameters.locate_events = true;
+                parameters.precision = precision;
+                Simulation sim(PART_C_NUM_PARTICLES, &parameters, true, DEFAULT_SEED, i + 1, &arena);
+                sim.n_threads = n_threads;
+                sim.run_ensemble('c');
                 percentages.emplace_back(sim.print_passing_percentage());
             }
             for (auto elem: percentages)
@@ -84,5 +161,150 @@ int main(int argc, char **argv)
         }
     }
 
+    else if (s_equals(argv[1], "convergence"))
+    {
+        //part B's setup, but final states only, levels in parallel and a stop at the round-off floor
+        for (const auto &method: {TAYLOR, MIDPOINT, RUNGE_KUTTA, SSPRK3, RK6, BORIS})
+        {
+            ProblemParameters params{};
+            params.method = method;
+            ConvergenceStudy study(params, {{0, 0}, {0, 3 * (params.E / params.B)}}, 0.01);
+            study.n_threads = n_threads;
+            study.run();
+            study.write_errors(method_name(method) + "_errors.csv");
+            std::cout << method_name(method) << ": order " << study.order << " over " << study.levels.size()
+                      << " levels\n";
+        }
+    }
+
+    else if (s_equals(argv[1], "estimate"))
+    {
+        //stage c's pass percentage to a requested precision instead of a fixed number of runs.
+        //optional fourth argument: target half-width of the 95 % interval, in percent
+        ProblemParameters params{FIELDS_RATIO, 1, PROTON_MASS, PROTON_CHARGE, 1e-9, 0.003, 1, RUNGE_KUTTA};
+        params.record = FINAL_ONLY;
+        params.locate_events = true;
+        params.precision = precision;
+        PassRateEstimator estimator(&params);
+        estimator.n_threads = n_threads;
+        estimator.target_half_width = arguments.size() > 2 ? std::stold(arguments[2]) : DEFAULT_TARGET_HALF_WIDTH;
+        auto result = estimator.run();
+        std::cout << "pass percentage " << result.estimate << " +- " << result.half_width << " % ("
+                  << result.particles << " particles, " << result.seconds << " s"
+                  << (result.converged ? "" : ", target not reached") << ")\n";
+    }
+
+    else if (s_equals(argv[1], "qmc"))
+    {
+        //spread of the pass percentage over independent replicates, pseudo-random against scrambled Sobol
+        for (const auto &sampling: {PSEUDO_RANDOM, SOBOL})
+        {
+            std::vector<long double> percentages;
+            for (std::uint32_t replicate = 0; replicate < QMC_REPLICATES; ++replicate)
+            {
+                ProblemParameters parameters{FIELDS_RATIO, 1, PROTON_MASS, PROTON_CHARGE, 1e-9, 0.003, 1,
+                                             RUNGE_KUTTA};
+                parameters.record = FINAL_ONLY;
+                parameters.locate_events = true;
+                parameters.precision = precision;
+                parameters.sampling = sampling;
+                Simulation sim(QMC_PARTICLES, &parameters, true, DEFAULT_SEED, replicate + 1);
+                sim.n_threads = n_threads;
+                sim.run_ensemble('c');
+                percentages.emplace_back(sim.print_passing_percentage());
+            }
+            auto mean = average(percentages);
+            long double variance = 0;
+            for (auto elem: percentages)
+            {
+                variance += (elem - mean) * (elem - mean) / (percentages.size() - 1);
+            }
+            std::cout << (sampling == SOBOL ? "sobol: " : "pseudo-random: ") << mean << " +- "
+                      << std::sqrt(variance / percentages.size()) << " %\n";
+        }
+    }
+
+    else if (s_equals(argv[1], "map"))
+    {
+        //build the acceptance map once, then classify a fresh ensemble with it and with the integrator
+        ProblemParameters params{FIELDS_RATIO, 1, PROTON_MASS, PROTON_CHARGE, 1e-9, 0.003, 1, RUNGE_KUTTA};
+        params.record = FINAL_ONLY;
+        params.locate_events = true;
+        auto start = std::chrono::steady_clock::now();
+        AcceptanceMap map(params, MIN_VELOCITY, MAX_VELOCITY, DEFAULT_MAP_TOLERANCE, n_threads);
+        auto built = std::chrono::steady_clock::now();
+        map.save("acceptance.map");
+
+        Simulation mapped(PART_C_NUM_PARTICLES, &params, true, DEFAULT_SEED, 1);
+        mapped.run_map(map);
+        auto classified = std::chrono::steady_clock::now();
+        Simulation integrated(PART_C_NUM_PARTICLES, &params, true, DEFAULT_SEED, 1);
+        integrated.n_threads = n_threads;
+        integrated.run_ensemble('c');
+
+        std::size_t disagreements = 0;
+        for (std::size_t i = 0; i < mapped.particles.size(); i++)
+        {
+            disagreements += mapped.particles[i].passed != integrated.particles[i].passed;
+        }
+        std::cout << map.passes_at_bottom.size() << " columns built in "
+                  << std::chrono::duration<double>(built - start).count() << " s, classified in "
+                  << std::chrono::duration<double>(classified - built).count() << " s\n"
+                  << "pass percentage " << mapped.print_passing_percentage() << " % (integrated "
+                  << integrated.print_passing_percentage() << " %), " << disagreements << " disagreements\n";
+    }
+
+    else if (s_equals(argv[1], "sweep"))
+    {
+        ProblemParameters base{FIELDS_RATIO, 1, PROTON_MASS, PROTON_CHARGE, 1e-9, 0.003, 1, RUNGE_KUTTA};
+        base.record = FINAL_ONLY;
+        base.locate_events = true;
+        ParameterSweep sweep(base, {SweepAxis::field("E", &ProblemParameters::E, {3.05e7, 3.09e7, 3.13e7}),
+                                    SweepAxis::field("R", &ProblemParameters::R, {0.002, 0.003, 0.004}),
+                                    SweepAxis::field("L", &ProblemParameters::L, {0.5, 1, 2}),
+                                    SweepAxis::methods({RUNGE_KUTTA, BORIS})}, 10000);
+        sweep.n_threads = n_threads;
+        auto results = sweep.run();
+        sweep.write_table("sweep.csv", results);
+        std::cout << results.size() << " points in " << sweep.wall_seconds << " s\n";
+    }
+
+    else if (s_equals(argv[1], "fringe"))
+    {
+        //stage c with fringe fields: E and B fall off over a tenth of the length at the entrance and exit
+        //(a fringe of the size of the gap would be shorter than one step of dt = 1e-9)
+        ProblemParameters params{FIELDS_RATIO, 1, PROTON_MASS, PROTON_CHARGE, 1e-9, 0.003, 1, RUNGE_KUTTA};
+        params.record = FINAL_ONLY;
+        params.locate_events = true;
+        double width = (double) params.L / 10;
+        auto profile = [&](double z) {
+            return 0.5 * (std::tanh(z / width) - std::tanh((z - (double) params.L) / width));
+        };
+        double dz = width / 8;
+        auto nz = (std::size_t) (((double) params.L + 10 * width) / dz) + 1;
+        FieldMap::sample(33, nz, (double) -params.R, -5 * width, (double) params.R / 16, dz, [&](double, double z) {
+            return FieldSample{params.E * profile(z), params.B * profile(z)};
+        }).save("fringe_fields.wff");
+        auto fields = FieldMap::load("fringe_fields.wff");
+
+        for (auto interpolation: {BILINEAR, BICUBIC})
+        {
+            fields.interpolation = interpolation;
+            for (auto *map: std::initializer_list<const FieldMap *>{nullptr, &fields})
+            {
+                params.fields = map;
+                Simulation simulation(FRINGE_PARTICLES, &params, true, DEFAULT_SEED, 1);
+                simulation.n_threads = n_threads;
+                auto start = std::chrono::steady_clock::now();
+                simulation.run_ensemble('c');
+                std::cout << (map ? (interpolation == BICUBIC ? "bicubic map" : "bilinear map") : "uniform")
+                          << ": pass percentage " << simulation.print_passing_percentage() << " % in "
+                          << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s\n";
+            }
+        }
+    }
+
+    //counters and phase times of the whole run, only in builds with NUMERICAL_CPP_INSTRUMENT
+    INSTRUMENT_DUMP("instrumentation.json");
     return 0;
 }